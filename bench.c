@@ -0,0 +1,485 @@
+//Benchmarks for the engine's hot paths.
+
+//Build it like the game, with the same -D flags to bench another board size or variant:
+//    cc -std=c2x -O2 -o bench bench.c -lm
+//Prints one CSV line per benchmark: benchmark,variant,ops,ns_per_op,ops_per_sec.
+//Save the output of one build and pass it to another with --compare to see the change side by side.
+
+#define TICTACTOE_NO_MAIN
+#include "tictactoe.c"
+
+enum {
+    BENCH_POSITIONS = 4096, //Random positions for the small benchmarks
+    BENCH_SAMPLES = 5, //Timed runs, the median is reported
+    BENCH_BASELINE_MAX = 64, //Lines read from a --compare file
+    BENCH_NAME_MAX = 64,
+    BENCH_PLAYOUTS = 1 << 14, //Per Monte Carlo tree search
+};
+
+//Inputs shared by the benchmarks, made once up front from a fixed seed so every run times the same work.
+typedef struct BenchData BenchData;
+struct BenchData {
+    Grid* grids; //BENCH_POSITIONS positions from random games
+    size_t* last_moves; //The move that made each of them
+    BitGrid* boards; //The same positions as bitboards
+    BitMask* xs; //Their X tiles, and O tiles, for the batch win checks
+    BitMask* os;
+    uint8_t* states; //Their results
+#if GRID_DENSE
+    GridStateMap* solved; //The whole game, solved
+    GridStateMap* empty; //Nothing solved, every lookup misses
+    GridStateMap* scratch; //For the full solves
+    Grid* reachable; //Every position in the solved table that isn't a finished game
+    size_t reachable_count;
+#endif
+    Search* search;
+    Mcts* mcts;
+};
+
+//Runs one batch of the benchmark, and returns something that depends on all of its results,
+//so the compiler can't drop the work.
+typedef uint64_t (*BenchFn)(BenchData* d);
+
+typedef struct BenchResult BenchResult;
+struct BenchResult {
+    char benchmark[BENCH_NAME_MAX];
+    char variant[BENCH_NAME_MAX];
+    double ns_per_op;
+};
+
+//Plays random games from the empty board, and keeps a position from each.
+//The engines that can use more than one thread get threads, 0 for one per core.
+//Returns false on allocation error.
+bool init_bench_data(BenchData* d, size_t threads) {
+    memset(d, 0, sizeof(BenchData)); //So it can be destroyed if this fails half way
+    uint64_t seed = 1;
+    d->grids = malloc(BENCH_POSITIONS * sizeof(Grid));
+    d->last_moves = malloc(BENCH_POSITIONS * sizeof(size_t));
+    d->boards = malloc(BENCH_POSITIONS * sizeof(BitGrid));
+    d->xs = malloc(BENCH_POSITIONS * sizeof(BitMask));
+    d->os = malloc(BENCH_POSITIONS * sizeof(BitMask));
+    d->states = malloc(BENCH_POSITIONS);
+    d->search = new_search();
+    d->mcts = new_mcts(0, BENCH_PLAYOUTS);
+    if (!d->grids || !d->last_moves || !d->boards || !d->xs || !d->os || !d->states || !d->search || !d->mcts) {
+        return false;
+    }
+    d->search->threads = threads;
+    d->mcts->threads = threads;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        Grid* g = reset(&d->grids[i]);
+        size_t const moves = 1 + next_random(&seed) % GRID_TOTAL;
+        for (size_t m = 0; m < moves && has_won(g) == EMPTY && !is_full(g); m++) {
+            size_t t = next_random(&seed) % GRID_TOTAL;
+            while (g->data[t] != EMPTY) {
+                t = (t + 1) % GRID_TOTAL;
+            }
+            move(g, t % GRID_X_DIM, t / GRID_X_DIM);
+            d->last_moves[i] = t;
+        }
+        d->boards[i] = bitgrid_from_grid(g);
+        d->xs[i] = d->boards[i].x;
+        d->os[i] = d->boards[i].o;
+    }
+#if GRID_DENSE
+    Grid start;
+    reset(&start);
+    d->solved = new_map();
+    d->empty = new_map();
+    d->scratch = new_map();
+    if (!d->solved || !d->empty || !d->scratch || calculate_position_retrograde(d->solved, &start) == UNKNOWN) {
+        return false;
+    }
+    d->scratch->threads = threads;
+    //The solved table's slots are the reachable positions, one per symmetry class.
+    d->reachable_count = 0;
+    d->reachable = malloc(packed_count(d->solved->data) * sizeof(Grid));
+    if (!d->reachable) {
+        return false;
+    }
+    for (size_t index = 0; index < STATE_TABLE_SIZE; index++) {
+        if (packed_get(d->solved->data, index) == UNKNOWN) {
+            continue;
+        }
+        BitGrid b = {0, 0, false};
+        size_t digits = index;
+        for (size_t t = 0; t < GRID_TOTAL; t++, digits /= 3) {
+            b.x |= (BitMask) (digits % 3 == X_PL) << t;
+            b.o |= (BitMask) (digits % 3 == O_PL) << t;
+        }
+        b.o_turn = count_tiles(b.o) < count_tiles(b.x);
+        if (bitgrid_has_won(b) == EMPTY && !bitgrid_is_full(b)) {
+            bitgrid_to_grid(b, &d->reachable[d->reachable_count++]);
+        }
+    }
+#endif
+    return true;
+}
+
+void destroy_bench_data(BenchData* d) {
+    free(d->grids);
+    free(d->last_moves);
+    free(d->boards);
+    free(d->xs);
+    free(d->os);
+    free(d->states);
+    destroy_search(d->search);
+    destroy_mcts(d->mcts);
+#if GRID_DENSE
+    destroy_map(d->solved);
+    destroy_map(d->empty);
+    destroy_map(d->scratch);
+    free(d->reachable);
+#endif
+}
+
+uint64_t bench_has_won(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += has_won(&d->grids[i]);
+    }
+    return sum;
+}
+
+uint64_t bench_is_winning_move(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += is_winning_move(&d->grids[i], d->last_moves[i] % GRID_X_DIM, d->last_moves[i] / GRID_X_DIM);
+    }
+    return sum;
+}
+
+uint64_t bench_is_full(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += is_full(&d->grids[i]);
+    }
+    return sum;
+}
+
+uint64_t bench_bitgrid_has_won(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += bitgrid_has_won(d->boards[i]);
+    }
+    return sum;
+}
+
+//The batch win checks, timed per board like has_won.
+//The results stay in memory, so the work can't be dropped without adding them up.
+uint64_t bench_winners_scalar(BenchData* d) {
+    winners_scalar(d->xs, d->os, BENCH_POSITIONS, d->states);
+    return d->states[BENCH_POSITIONS - 1];
+}
+
+#if HAVE_X86_SIMD
+uint64_t bench_winners_sse2(BenchData* d) {
+    winners_sse2(d->xs, d->os, BENCH_POSITIONS, d->states);
+    return d->states[BENCH_POSITIONS - 1];
+}
+
+uint64_t bench_winners_avx2(BenchData* d) {
+    winners_avx2(d->xs, d->os, BENCH_POSITIONS, d->states);
+    return d->states[BENCH_POSITIONS - 1];
+}
+#endif
+
+//Checks the vector batch win checks this processor has against the scalar one, on the positions and on them
+//with X and O swapped, so a broken kernel fails the run instead of being timed. Prints what's wrong.
+bool check_winners(BenchData* d) {
+    bool ok = true;
+#if HAVE_X86_SIMD
+    struct {
+        char const * name;
+        WinnersFn fn;
+    } const kernels[] = {
+        {"sse2", winners_sse2},
+        {"avx2", WINNERS == winners_avx2 ? winners_avx2 : nullptr}, //Only where the processor has it
+    };
+    uint8_t expected[BENCH_POSITIONS];
+    for (int swap = 0; swap < 2; swap++) {
+        BitMask const * const xs = swap ? d->os : d->xs;
+        BitMask const * const os = swap ? d->xs : d->os;
+        winners_scalar(xs, os, BENCH_POSITIONS, expected);
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            if (!kernels[k].fn) {
+                continue;
+            }
+            kernels[k].fn(xs, os, BENCH_POSITIONS, d->states);
+            for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+                if (d->states[i] != expected[i]) {
+                    fprintf(stderr, "winners_%s is wrong: board %zu%s gives %u, not %u\n",
+                        kernels[k].name, i, swap ? " swapped" : "", d->states[i], expected[i]);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+#else
+    (void) d;
+#endif
+    return ok;
+}
+
+//A fresh search from the empty board, so clearing the table is part of it.
+uint64_t bench_search(BenchData* d) {
+    Grid start;
+    reset(&start);
+    size_t best = GRID_TOTAL;
+    clear_search(d->search);
+    return search_position(d->search, &start, &best) + best;
+}
+
+//Monte Carlo tree search from the empty board, on --threads threads, timed per playout.
+//The random numbers depend on the thread timing, so the work isn't quite the same every run.
+uint64_t bench_mcts(BenchData* d) {
+    Grid start;
+    reset(&start);
+    d->mcts->seed = 0;
+    return mcts_run(d->mcts, &start, thread_count(d->mcts->threads));
+}
+
+#if GRID_DENSE
+uint64_t bench_hash_grid(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += hash_grid(d->boards[i]);
+    }
+    return sum;
+}
+
+uint64_t bench_canonical_grid(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += canonical_grid(d->boards[i], nullptr).x;
+    }
+    return sum;
+}
+
+uint64_t bench_lookup_hit(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += map_lookup_with_insert(d->solved, d->boards[i], false, UNKNOWN);
+    }
+    return sum;
+}
+
+uint64_t bench_lookup_miss(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += map_lookup_with_insert(d->empty, d->boards[i], false, UNKNOWN);
+    }
+    return sum;
+}
+
+uint64_t bench_find_possible_moves(BenchData* d) {
+    uint64_t sum = 0;
+    BitGrid moves[GRID_TOTAL];
+    for (size_t i = 0; i < BENCH_POSITIONS; i++) {
+        sum += find_possible_moves(d->boards[i], moves);
+    }
+    return sum;
+}
+
+uint64_t bench_best_move_from_map(BenchData* d) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < d->reachable_count; i++) {
+        sum += best_move_from_map(d->solved, &d->reachable[i]);
+    }
+    return sum;
+}
+
+uint64_t bench_solve(BenchData* d, Solver solver) {
+    Grid start;
+    reset(&start);
+    reset_map(d->scratch);
+    return solver(d->scratch, &start);
+}
+
+uint64_t bench_solve_bfs(BenchData* d) {
+    return bench_solve(d, calculate_position);
+}
+
+uint64_t bench_solve_retrograde(BenchData* d) {
+    return bench_solve(d, calculate_position_retrograde);
+}
+
+uint64_t bench_solve_layered(BenchData* d) {
+    return bench_solve(d, calculate_position_layered);
+}
+#endif
+
+//Keeps the checksums alive.
+static volatile uint64_t BENCH_SINK;
+
+//Seconds for reps runs of fn.
+double time_runs(BenchFn fn, BenchData* d, size_t reps) {
+    double const begin = seconds_now();
+    for (size_t r = 0; r < reps; r++) {
+        BENCH_SINK += fn(d);
+    }
+    return seconds_now() - begin;
+}
+
+int compare_doubles(void const * a, void const * b) {
+    double const x = *(double const *) a;
+    double const y = *(double const *) b;
+    return (x > y) - (x < y);
+}
+
+//Times fn, which does ops operations per run. After a warm up run, the runs are batched
+//so that each sample takes at least min_time / BENCH_SAMPLES, and the median sample is kept.
+double run_benchmark(BenchFn fn, BenchData* d, size_t ops, double min_time) {
+    double const sample_time = min_time / BENCH_SAMPLES;
+    size_t reps = 1;
+    double elapsed = time_runs(fn, d, reps); //Warm up: caches, branch predictors and the arenas
+    while (elapsed < sample_time) {
+        reps *= 2;
+        elapsed = time_runs(fn, d, reps);
+    }
+    double samples[BENCH_SAMPLES];
+    samples[0] = elapsed;
+    for (size_t i = 1; i < BENCH_SAMPLES; i++) {
+        samples[i] = time_runs(fn, d, reps);
+    }
+    qsort(samples, BENCH_SAMPLES, sizeof(double), compare_doubles);
+    return samples[BENCH_SAMPLES / 2] * 1e9 / ((double) reps * ops);
+}
+
+//Reads the results saved from an earlier run, skipping anything that isn't a result line.
+//Returns how many were read.
+size_t read_baseline(char const * const path, BenchResult results[BENCH_BASELINE_MAX]) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    size_t count = 0;
+    char line[LINE_MAX];
+    while (count < BENCH_BASELINE_MAX && fgets(line, sizeof(line), file)) {
+        BenchResult* r = &results[count];
+        if (sscanf(line, "%63[^,],%63[^,],%*[^,],%lf", r->benchmark, r->variant, &r->ns_per_op) == 3) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+/*
+Options:
+--filter text: only run the benchmarks with text in their name.
+--min-time s: time each benchmark for at least s seconds, 1 by default.
+--threads n: run the layered solver, the search and Monte Carlo tree search on n threads, 0 for one per core.
+--compare file: add the results in file, from an earlier run, and the change from them.
+--max-regression pct: with --compare, exit with failure if anything got more than pct percent slower.
+*/
+int main(int argc, char** argv) {
+    init_tables();
+
+    char const * filter = nullptr;
+    char const * compare_path = nullptr;
+    double min_time = 1.0;
+    double max_regression = -1;
+    size_t threads = 0;
+    uint64_t value = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = strtod(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!parse_option_count("--threads", argv[++i], 0, THREADS_MAX, &value)) {
+                return EXIT_FAILURE;
+            }
+            threads = value;
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-regression") == 0 && i + 1 < argc) {
+            max_regression = strtod(argv[++i], nullptr);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    BenchResult baseline[BENCH_BASELINE_MAX];
+    size_t const baseline_count = compare_path ? read_baseline(compare_path, baseline) : 0;
+    if (compare_path && baseline_count == 0) {
+        fprintf(stderr, "No results in %s\n", compare_path);
+        return EXIT_FAILURE;
+    }
+
+    BenchData data;
+    if (!init_bench_data(&data, threads)) {
+        fprintf(stderr, "Allocation error\n");
+        destroy_bench_data(&data);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Batch win checks: %s\n", WINNERS_NAME);
+    if (!check_winners(&data)) {
+        destroy_bench_data(&data);
+        return EXIT_FAILURE;
+    }
+
+    //The variant tells builds and engines apart in the output, eg. the board size, or which solver.
+    char board[BENCH_NAME_MAX];
+    snprintf(board, sizeof(board), "%dx%dk%d", GRID_X_DIM, GRID_Y_DIM, GRID_K);
+    struct {
+        char const * name;
+        char const * variant;
+        BenchFn fn;
+        size_t ops;
+    } const benchmarks[] = {
+        {"has_won", board, bench_has_won, BENCH_POSITIONS},
+        {"is_winning_move", board, bench_is_winning_move, BENCH_POSITIONS},
+        {"is_full", board, bench_is_full, BENCH_POSITIONS},
+        {"bitgrid_has_won", board, bench_bitgrid_has_won, BENCH_POSITIONS},
+        //0 ops skips it, for processors without AVX2.
+        {"winners_batch", "scalar", bench_winners_scalar, BENCH_POSITIONS},
+#if HAVE_X86_SIMD
+        {"winners_batch", "sse2", bench_winners_sse2, BENCH_POSITIONS},
+        {"winners_batch", "avx2", bench_winners_avx2, WINNERS == winners_avx2 ? BENCH_POSITIONS : 0},
+#endif
+#if GRID_DENSE
+        {"hash_grid", board, bench_hash_grid, BENCH_POSITIONS},
+        {"canonical_grid", board, bench_canonical_grid, BENCH_POSITIONS},
+        {"map_lookup_hit", board, bench_lookup_hit, BENCH_POSITIONS},
+        {"map_lookup_miss", board, bench_lookup_miss, BENCH_POSITIONS},
+        {"find_possible_moves", board, bench_find_possible_moves, BENCH_POSITIONS},
+        {"best_move_from_map", board, bench_best_move_from_map, data.reachable_count},
+#if GRID_TOTAL <= 12
+        //The breadth first search takes too long on bigger boards.
+        {"solve", "bfs", bench_solve_bfs, 1},
+#endif
+        {"solve", "retrograde", bench_solve_retrograde, 1},
+        {"solve", "layered", bench_solve_layered, 1},
+#endif
+        {"solve", "alpha-beta", bench_search, 1},
+        {"mcts_playout", board, bench_mcts, BENCH_PLAYOUTS},
+    };
+
+    int ret = EXIT_SUCCESS;
+    printf("benchmark,variant,ops,ns_per_op,ops_per_sec%s\n", compare_path ? ",baseline_ns_per_op,change_pct" : "");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if ((filter && !strstr(benchmarks[i].name, filter)) || benchmarks[i].ops == 0) {
+            continue;
+        }
+        double const ns = run_benchmark(benchmarks[i].fn, &data, benchmarks[i].ops, min_time);
+        printf("%s,%s,%zu,%.3f,%.6g", benchmarks[i].name, benchmarks[i].variant, benchmarks[i].ops, ns, 1e9 / ns);
+        for (size_t b = 0; b < baseline_count; b++) {
+            if (strcmp(baseline[b].benchmark, benchmarks[i].name) == 0 && strcmp(baseline[b].variant, benchmarks[i].variant) == 0) {
+                double const change = (ns / baseline[b].ns_per_op - 1) * 100;
+                printf(",%.3f,%+.1f", baseline[b].ns_per_op, change);
+                if (max_regression >= 0 && change > max_regression) {
+                    ret = EXIT_FAILURE;
+                }
+                break;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    destroy_bench_data(&data);
+    return ret;
+}
@@ -1,986 +1,4623 @@
-//Tic tac toe game, with an algorithmic opponent
-
-#include<stdio.h>
-#include<stdlib.h>
-
-enum {
-    GRID_X_DIM = 3,
-    GRID_Y_DIM = 3,
-    GRID_TOTAL = 9,
-    LINE_MAX = 256,
-    GRID_MAP_HASH_MAX = 499,
-};
-
-typedef enum Tile Tile;
-
-enum Tile {
-    EMPTY = 0,
-    X_PL = 1,
-    O_PL = 2,
-    TOTAL_TILES = 3, //Error condition return as well. 
-};
-
-//this is just a switch case
-//returns the null character on error. 
-
-char const tile_to_char(Tile const t) {
-    switch (t) {
-    case EMPTY: 
-        return 'E';
-    case X_PL:
-        return 'X';
-    case O_PL:
-        return 'O';
-    default:
-        return '\0';
-    }
-}
-//We use tiles to keep track of the current player as well. 
-//X is the starting player by default
-//Player uses EMPTY and TOTAL_TILES as error states
-
-typedef Tile Player;
-char const * const player_to_string(Player const p) {
-    switch (p) {
-    case X_PL:
-        return "Player X";
-    case O_PL:
-        return "Player O";
-    default:
-        return "Error, no current player";
-    }
-}
-
-Player next_player(Player p) {
-    switch (p) {
-    case X_PL:
-        return O_PL;
-    case O_PL:
-        return X_PL;
-    default:
-        return EMPTY;
-    }
-}
-
-//This is just a wrapper around a grid.
-
-//We access using x, y coordinates, 0 <= x, y <= 3.
-
-//Contains the world state
-
-typedef struct Grid Grid;
-//Has grid data and turn
-struct Grid {
-    Tile data [GRID_TOTAL];
-    Player player;
-};
-
-Grid* reset(Grid* g) {
-    for (size_t i = 0; i < GRID_TOTAL; i++) {
-        g->data[i] = EMPTY;
-    }
-    g->player = X_PL;
-    return g;
-}
-
-Grid* init_new_grid() {
-    Grid *p = malloc(sizeof(Grid));
-    reset(p);
-    return p;
-}
-
-size_t get_index (size_t x, size_t y) {
-    return y*GRID_X_DIM + x;
-}
-
-//Returns TOTAL if out of bounds error
-Tile get(Grid const* g, size_t x, size_t y) {
-    if (x < 3 && y < 3) {
-        return g->data[get_index(x, y)];
-    }
-    else {
-        return TOTAL_TILES;
-    }
-}
-
-//Tiles are copyable, do not need pointers
-//Returns TOTAL if out of bounds
-Tile set(Grid* g, size_t x, size_t y, Tile t) {
-    if (x < 3 && y < 3) {
-        g->data[get_index(x, y)] = t;
-        return t;
-    }
-    else {
-        return TOTAL_TILES;
-    }
-}
-
-//RETURNS TOTAL_TILES on failure, ie if the spot at x, y was already taken.
-Tile move(Grid* g, size_t x, size_t y) {
-    Tile ret = TOTAL_TILES;
-    if (get(g, x, y) == EMPTY) {
-        ret = set(g, x, y, g->player);
-        g->player = next_player(g->player);
-    }
-    return ret;
-}
-
-//Doesn't check errors, prints empty character on error. 
-void print_grid(Grid const * const g) {
-    char current = 'E';
-    printf("Current turn: %s\n", player_to_string(g->player));
-    for (size_t y = 0; y < GRID_Y_DIM; y++) {
-        for (size_t x = 0; x < GRID_X_DIM; x++) {
-            current = tile_to_char(g->data[get_index(x,y)]);
-            printf("%c ", current);
-            //May print '\0' which is empty?
-            //THIS MIGHT BE A BUG, NOT QUITE SURE
-        }
-        printf("\n");
-    }
-    printf("\n");
-}
-
-//Copies without allocation
-Grid* copy_grid_into(Grid const* const p1, Grid* p2) {
-    if (p2) {
-        for (size_t i = 0; i < GRID_TOTAL; i++) {
-            p2->data[i] = p1->data[i];
-        }
-        p2->player = p1->player;
-    }
-    return p2;
-}
-//Copies with allocation
-//Returns null on failure. 
-Grid* copy(Grid const * const p) {
-    return copy_grid_into(p, malloc(sizeof(Grid)));
-}
-
-void destroy(Grid* g) {
-    free(g);
-}
-
-bool equals(Grid const * const g1, Grid const * const g2) {
-    if (g1 && g2) {
-        if (g1->player != g2->player) {
-            return false;
-        }
-        for (size_t i = 0; i < GRID_TOTAL; i++) {
-            if (g1->data[i] != g2->data[i]) {
-                return false;
-            }
-        }
-        return true;
-    } else {
-        return false;
-    }
-}
-
-
-//Checks if the last move played at x, y is a winning move. 
-bool is_winning_move(Grid const * const g, size_t x, size_t y) {
-    Player maybe_winner = get(g, x, y);
-    //First checks if the move was possible
-    if (maybe_winner == EMPTY) {
-        return false;
-    }
-
-    //Check rook moves
-    //Horizontal check
-    bool horizontal_win = true;
-    for (size_t i = 0; i < GRID_X_DIM; i++) {
-        if (get(g, i, y) != maybe_winner) {
-
-            horizontal_win = false;
-            break;
-        }
-    }
-
-    if (horizontal_win) {
-        return true;
-    }
-
-    //Vertical check
-    bool vertical_win = true;
-    for (size_t i = 0; i < GRID_Y_DIM; i++) {
-        if (get(g, x, i) != maybe_winner) {
-            vertical_win = false;
-            break;
-        }
-    }
-
-    if (vertical_win) {
-        return true;
-    }
-
-    //Check diagonals
-    //Positive slope diagonal
-    if (x - y == 0) {
-        bool diag_win = true;
-        for (size_t i = 0; i < GRID_Y_DIM; i++) {
-            if (get(g, i, i) != maybe_winner) {
-                diag_win = false;
-                break;
-            }
-        }
-        if (diag_win) {
-            return true;
-        }
-    }
-    //Check other diagonal
-    if (x + y == 2) {
-        bool diag_win = true;
-        for (size_t i = 0; i < GRID_Y_DIM; i++) {
-            if (get(g, i, 2 - i) != maybe_winner) {
-                diag_win = false;
-                break;
-            }
-        }
-        if (diag_win) {
-            return true;
-        }
-    }
-    return false;
-}
-
-
-Player has_won(Grid const * const g) {
-    //Checks with 1, 1
-    Player pot_winner = get(g, 1, 1);
-    if (pot_winner != EMPTY) {
-        //Diagonal checks
-        if ( ( pot_winner == get(g, 0, 0) ) && ( pot_winner == get(g, 2, 2) ) ) {
-            return pot_winner;
-        } else if ( (pot_winner == get(g, 2, 0)) && (pot_winner == get(g, 0, 2)) ) {
-            return pot_winner;
-        } else if ((pot_winner == get(g, 1, 0)) && (pot_winner == get(g, 1, 2))) {
-            return pot_winner;
-        } else if ( (pot_winner) == get(g, 0, 1) && (pot_winner == get(g, 2, 1))) {
-            return pot_winner;
-        }
-    }
-
-    //Check the boundary wins
-
-    pot_winner = get(g, 0, 0);
-
-    if (pot_winner != EMPTY) {
-        if (( pot_winner == get(g, 1, 0) ) && ( pot_winner == get(g, 2, 0) ) ) {
-            return pot_winner;
-        } else if (( pot_winner == get(g, 0, 1) ) && ( pot_winner == get(g, 0, 2) ) ) {
-            return pot_winner;
-        }
-    }
-
-    pot_winner = get(g, 2, 2);
-
-    if (pot_winner != EMPTY) {
-        if (( pot_winner == get(g, 1, 2) ) && ( pot_winner == get(g, 0, 2) ) ) {
-            return pot_winner;
-        } else if (( pot_winner == get(g, 2, 1) ) && ( pot_winner == get(g, 2, 0) ) ) {
-            return pot_winner;
-        }
-    }
-    //No winner
-    return EMPTY;
-}
-
-//Returns empty if no one has won yet.
-/*
-Player has_won(Grid const * const g) {
-    //Checks including 1, 1
-    
-    if (is_winning_move(g, 1, 1)) {
-        return get(g, 1, 1);
-    } else {
-        //Check vert and horizontal at 0,0 and 2,2
-        
-        Player pot_winner = get(g, 0, 0);
-
-        if (pot_winner != EMPTY) {
-            bool horizontal_win = true;
-            for (size_t i = 0; i < GRID_X_DIM; i++) {
-                if (get(g, i, 0) != pot_winner) {
-                    horizontal_win = false;
-                    break;
-                }
-            }
-            if (horizontal_win) {
-                return pot_winner;
-            }
-            bool vertical_win = true;
-            for (size_t j = 0; j < GRID_Y_DIM; j++) {
-                if (get(g, 0, j) != pot_winner) {
-                    vertical_win = false;
-                    break;
-                }
-            } 
-            if (vertical_win) {
-                return pot_winner;
-            }
-        } else {
-            pot_winner = get(g, 2, 2);
-            bool horizontal_win = true;
-            for (size_t i = 0; i < GRID_X_DIM; i++) {
-                if (get(g, i, 2) != pot_winner) {
-                    horizontal_win = false;
-                    break;
-                }
-            }
-            if (horizontal_win) {
-                return pot_winner;
-            }
-            bool vertical_win = true;
-            for (size_t j = 0; j < GRID_Y_DIM; j++) {
-                if (get(g, 2, j) != pot_winner) {
-                    vertical_win = false;
-                    break;
-                }
-            } 
-            if (vertical_win) {
-                return pot_winner;
-            }
-        }
-        return EMPTY;
-    }
-}
-*/
-bool is_full(Grid const * const g) {
-    for (size_t i = 0; i < GRID_TOTAL; i++) {
-        if (g->data[i] == EMPTY) {
-            return false;
-        }
-    }
-    return true;
-}
-
-typedef struct GridList GridList;
-
-struct GridList {
-    Grid const * grid;
-    GridList* next;
-};
-
-//Empty tiles number should always match the size of the array possible moves. 
-
-//Creates new empty board
-GridList* init_GridList_from_pointer(GridList* pt) {
-    if (pt) {
-        pt->grid = init_new_grid();
-        pt->next = nullptr;
-    }
-    return pt;
-}
-//Grid is borrowed into GridList
-GridList* init_from_grid (GridList* pt, Grid const * const grid) {
-    if (pt) {
-        pt->next = nullptr;
-        pt->grid = grid;
-        return pt;
-    }
-    return nullptr;
-
-}
-
-GridList* init_from_grid_copy(GridList* pt, Grid const * const g) {
-    if (pt && (pt->grid = copy(g))) {
-        pt->next = nullptr;
-        return pt;
-    }
-    //Allocation error
-    return nullptr;
-}
-
-GridList* new_grid_copy(Grid const * const g) {
-    return init_from_grid_copy(malloc(sizeof(GridList)), g);
-}
-
-//Only use from new!
-//Commented out: GridList doesn't own the grid!!
-
-void destroy_grid_list_keep_grids(GridList* p) {
-    if (p) {
-        GridList* iter = p;
-        while(iter != nullptr) {
-            GridList* next = iter->next;
-            free(iter);
-            iter = next;
-        }
-    }
-}
-
-
-/*
-typedef struct GameTree GameTree;
-struct GameTree {
-    Grid const* current_grid;
-    GridList* possible_moves; //List of next values
-    size_t empty_tiles; //is the same as the size of possible moves.
-    Player player;
-};
-
-//This consumes the pointer, do not use current_grid afterwards
-GameTree* init(Grid const* current_grid, Player player) {
-    GameTree *ret = malloc(sizeof(GameTree));
-
-    ret->current_grid = current_grid;
-    ret->player = player;
-    ret->possible_moves = find_possible_moves(current_grid, player);
-    return ret;
-}
-*/
-//Keeps track of state 
-
-//Has the same ordering as Tile and Player
-//UNKNOWN = EMPTY 
-//X_WIN = X_PL
-//O_WIN = O_PL
-//DRAW == TOTAL
-enum WinState {
-    UNKNOWN = 0, // Sentinel value
-    X_WIN = 1,
-    O_WIN = 2,
-    DRAW = 4,
-};
-
-typedef enum WinState WinState;
-
-char const * const state_to_string(WinState state) {
-    switch (state) {
-    case X_WIN:
-        return "X wins";
-    case O_WIN:
-        return "O wins";
-    case DRAW:
-        return "Draw";
-    default:
-        return "Win state unknown";
-    }
-} 
-
-//Used to make a hashmap
-
-typedef struct GridStateNode GridStateNode;
-struct GridStateNode {
-    Grid const * grid;
-    WinState state;
-    GridStateNode* next;
-};
-
-//Memoization solution
-
-//The map will own all the Grid objects that we make.
-struct GridStateMap {
-    GridStateNode* data [GRID_MAP_HASH_MAX];
-};
-
-typedef struct GridStateMap GridStateMap;
-
-GridStateMap* init_map(GridStateMap* mpt) {
-    if (mpt) {
-        for (size_t i = 0; i < GRID_MAP_HASH_MAX; i++) {
-            mpt->data[i] = nullptr;
-        }
-    }
-    return mpt;
-}
-
-
-GridStateMap* new_map() {
-    return init_map(malloc(sizeof(GridStateMap)));
-}
-
-//Does not consume
-size_t hash_grid(Grid const g) {
-    size_t h = 0;
-    h += g.player;
-    for (size_t i = 0; i < GRID_TOTAL; i++) {
-        h += g.data[i];
-    }
-    return h % GRID_MAP_HASH_MAX;
-}
-//CANNOT DOUBLE INSERT!!
-//If insert is true, this DOESN'T CONSUME the grid pointer grid. 
-GridStateNode* map_lookup_with_insert(GridStateMap* map, Grid const * const grid, bool insert, WinState state) {
-    size_t hash = hash_grid(*grid);
-    
-    for (GridStateNode* pt = map->data[hash]; pt != nullptr; pt = pt->next) {
-        if (equals(grid, pt->grid)) {
-            
-            return pt;
-        }
-    }
-    ;
-    GridStateNode * ret = nullptr;
-
-    if (insert && (ret = malloc(sizeof(GridStateNode))) && (ret->grid = copy(grid))) {
-        ret->state = state;
-        ret->next = map->data[hash];
-        map->data[hash] = ret; //appended it to the front
-    } else {
-        free(ret);
-        ret = nullptr;
-    }
-    return ret;
-}
-
-
-//Allocates new Grid list to hold all possible moves.
-
-//Should make this return list with grid pointers to hashmap??
-//Then it doesn't necessarily reallocates.
-//Use map insert!
-//It will create the node in the map,
-//then builds the GridList using the grids that are held in the map
-GridList* find_possible_moves_into_map(GridStateMap* map, Grid const* current_grid) {
-    GridList* current_list = nullptr;
-    //holds space for a temp object
-    GridList* temp_list = nullptr;
-    
-    Grid temp_grid;
-    //Initializes temp by copying the current_grid.
-    copy_grid_into(current_grid, &temp_grid);
-
-    Player const current_player = current_grid->player;
-    Player const other_player = next_player(current_player);
-
-    //temp_grid will contain the next moves, so we record the next player
-    temp_grid.player = other_player;
-    //Right now temp grid is in an invalid position: wrong player to move. 
-
-    GridStateNode* node = nullptr;
-
-    if (is_full(current_grid)) {
-        return nullptr; //No next states
-    }
-    for (size_t i = 0; i < GRID_TOTAL; i++) {
-        if (temp_grid.data[i] == EMPTY) {
-            //Move to the empty tile with player
-            temp_grid.data[i] = current_player; 
-            //We changed temp_grid to a valid position
-            //Add into the map with sentinel value, if it hasn't been yet.
-            //This allocates space for a new grid object in the map.
-            //This only borrows temp_grid.
-
-            node = map_lookup_with_insert(map, &temp_grid, true, UNKNOWN);
-
-
-            if (!node) {
-                destroy_grid_list_keep_grids(current_list);
-                return nullptr;
-            } 
-            //Change temp back
-            temp_grid.data[i] = EMPTY;
-            //If allocation error
-            
-            //Borrows the grid from the map
-            if (temp_list = malloc(sizeof(GridList))){
-                init_from_grid(temp_list, node->grid);
-                temp_list->next = current_list;
-                current_list = temp_list;
-        
-            } else {
-                //allocation error!
-                //cleanup code
-                //We DO NOT free the grid, as it's the map's responsibility. 
-                destroy_grid_list_keep_grids(current_list);
-                return nullptr;
-            }            
-        }
-    }
-    return current_list;
-}
-
-
-
-//Populates the map with the given starting grid
-
-//Do breadth first search: add the possible moves to the end. 
-WinState calculate_position(GridStateMap* map, Grid const * const start_grid) {
-    GridList* to_calculate = new_grid_copy(start_grid);
-
-    GridList* current_node = nullptr; //Used to pop to_calculate
-
-    GridList* end = to_calculate;
-
-    Grid const* current_grid;
-    Player current_player;
-    while(to_calculate != nullptr) {
-        current_node = to_calculate;
-
-        current_grid = current_node->grid;
-        current_player = current_grid->player;
-        //Check if current is an ended game:
-        //Or if the position has been calculated already
-
-        GridStateNode* map_node = map_lookup_with_insert(map, current_grid, true, UNKNOWN);
-        //Only inserts if we cannot find it.
-        if (!map_node) {
-            //Error checking! abort and clean up.
-            //printf("Allocation error\n");
-            while (to_calculate != nullptr) {
-                current_node = to_calculate;
-                to_calculate = to_calculate->next;
-                free(current_node);
-            }
-        }
-        //If we haven't seen it before!
-        if (map_node->state == UNKNOWN) {
-            Player pot_winner = has_won(current_grid);
-            //printf("Potential winner: %s\n", player_to_string(pot_winner));
-            //print_grid(map_node->grid);
-            if (pot_winner != EMPTY) {
-                map_node->state = (WinState) pot_winner; //This is just an integer cast.
-
-        
-            } else if (is_full(current_grid)) {
-                //Draw condition
-                //printf("Drawing position: \n");
-                //print_grid(map_node->grid);
-                map_node->state = DRAW;
-            }
-        } 
-        //This happens if we have calculated the node before, or
-        //if we just assigned it a value.
-        if (map_node->state != UNKNOWN) {
-            //Pop the current one from list, we're done processing it.
-            //We ONLY free the pointer at to_calculate, DO NOT DESTROY GRID
-            //As the grid is in the map
-            //printf("State is %s\n", state_to_string(map_node->state));
-            //print_grid(map_node->grid);
-            to_calculate = to_calculate->next;
-            free(current_node);
-            //No need for extra processing.
-            continue;
-        }
-
-        //Otherwise, we need to process all the possible moves from the current position. 
-        GridList* possible_moves = find_possible_moves_into_map(map, current_grid);
-
-        //Add the possible moves to our map (giving it the ownership!!)
-        //As well as process if the next possible moves are all processed
-
-        //If we see a winning state (so a losing state for the next player), it's a win.
-
-        //If all are losses, it's a loss
-
-        //else it's a draw. 
-        bool is_win = false;
-        bool add_to_list = false;
-        bool all_losses = true;
-        GridList* prev = nullptr;
-
-        GridStateNode* iter_node = nullptr;
-
-        for (GridList* iter = possible_moves; iter != nullptr; iter = iter->next) {
-            //This isn't hit at the last iteration when iter == nullptr
-            prev = iter;
-
-            iter_node = map_lookup_with_insert(map, iter->grid, false, UNKNOWN);
-
-            if (iter_node->state == (WinState) current_player) {
-                //If we see a winning state (so a losing state for the next player), it's a win.
-                map_node->state = (WinState) current_player;
-                is_win = true; //Pop the current grid from list
-                all_losses = false;
-                add_to_list = false;
-                break;
-            } else if (add_to_list) {
-                continue;
-            } else if (iter_node->state == UNKNOWN) {
-                //We need more processing
-                //Add list to the front of to_calculate
-                all_losses = false;
-                add_to_list = true;
-                continue; //We want to loop to the end of the list anyway here
-            } else if (iter_node->state == DRAW) {
-                //At least one draw, so it isn't a loss
-                all_losses = false;
-            }
-        }
-        //If we find a win, there is no need to calculate the other positions!
-        if (is_win) {
-            to_calculate = to_calculate->next;
-
-            free(current_node);
-
-            //printf("Current move %s, state: %s\n", player_to_string(current_grid->player), state_to_string(map_node->state));
-            //print_grid(current_grid);
-
-        } else if (add_to_list) {
-            //Links the lists, as there are unprocessed things.
-            
-            end->next = possible_moves;
-            prev->next = current_node;
-
-            to_calculate = to_calculate->next;
-
-            //Re use current_node
-            current_node->next = nullptr;
-            end = current_node;
-
-            
-        } else if (all_losses) {
-            //Loss condition
-            map_node->state = (WinState) next_player(current_player);
-            to_calculate = to_calculate->next;
-
-            free(current_node);
-            //printf("Current move %s, state: %s\n", player_to_string(current_grid->player), state_to_string(map_node->state));
-            //print_grid(current_grid);
-
-        } else {
-            //Draw condition. Not any of the previous: either a win or all losses.
-            map_node->state = DRAW;
-            to_calculate = to_calculate->next;
-
-            free(current_node);
-            //printf("Current move %s, state: %s\n", player_to_string(current_grid->player), state_to_string(map_node->state));
-            //print_grid(current_grid);
-        }
-        //Finally pop, cleanup of current_node done. 
-    }
-    return map_lookup_with_insert(map, start_grid, false, UNKNOWN)->state;
-}
-
-
-/*
-Returns an integer 0 <= t <= 8 for the location of the next best move.
-Assumes the win states have been calculated already. 
-*/
-
-size_t best_move_from_map(GridStateMap * map, Grid const * const grid) {
-    
-    GridStateNode* map_node = map_lookup_with_insert(map, grid, false, UNKNOWN);
-
-    if (!map_node || map_node->state == UNKNOWN) {
-        return GRID_TOTAL; //Error condition: we must have generated the map already.
-    }
-
-    Player player = grid->player; //The player we're finding the best move for.
-    WinState target_state = map_node->state; //This is the state we're looking for.  
-
-
-    //If we have a losing board
-    if (target_state == (WinState) next_player(player)) {
-        //Check best squares on the board.
-        //Middle square is best
-        if (get(grid, 1, 1) == EMPTY) {
-            return get_index(1, 1);
-        } 
-        //Next do corner squares
-        else if (get(grid, 0, 0) == EMPTY) {
-            return get_index(0, 0);
-        } else if (get(grid, 2, 0) == EMPTY) {
-            return get_index(2, 0);
-        } else if (get(grid, 0, 2) == EMPTY) {
-            return get_index(0, 2);
-        } else if (get(grid, 2, 2) == EMPTY) {
-            return get_index(2, 2);
-        }
-        //Last just check the rest of them
-        else if (get(grid, 1, 0) == EMPTY) {
-            return get_index(1, 0);
-        } else if (get(grid, 1, 2) == EMPTY) {
-            return get_index(1, 2);
-        } else if (get(grid, 0, 1) == EMPTY) {
-            return get_index(0, 1);
-        } else if (get(grid, 2, 1) == EMPTY) {
-            return get_index(2, 1);
-        } else {
-            return GRID_TOTAL; //This is returned if the board is full. 
-        }
-    } 
-
-    //Otherwise: We loop through the possible moves for lower overhead
-    //Temp holds the current new move we're looking at.
-    Grid temp;
-
-    copy_grid_into(grid, &temp);
-    temp.player = next_player(player);
-
-    //State should be either our player or is DRAW. 
-
-    GridStateNode* iter_node = nullptr;
-
-    //If the board is a draw or win:
-
-
-    for (size_t i = 0; i < GRID_TOTAL; i++) {
-        if (grid->data[i] == EMPTY) {
-            temp.data[i] = player;
-
-            iter_node = map_lookup_with_insert(map, &temp, false, UNKNOWN);
-
-            temp.data[i] = EMPTY; //Reset temp
-
-            if (!iter_node || iter_node->state == UNKNOWN) {
-                return GRID_TOTAL; //Again, this is an error condition. Map wasn't sufficiently generated
-            }
-
-            //Now we calculate the logic
-
-            //If we find a condition matching the target state, return this as the move
-            if (iter_node->state == target_state) {
-                return i;
-            }
-        }
-    }
-
-    return GRID_TOTAL; //This is an error condition: couldn't find win or draw??
-}
-
-
-/*
-TODO need to integrate the search function.
-*/
-int main() {
-
-    Grid BOARD;
-    Grid* bpt = reset(&BOARD);
-
-    BOARD.player = X_PL;
-    char line[LINE_MAX];
-
-    size_t move_x = 0;
-    size_t move_y = 0;
-    Player current_player = X_PL;
-
-    printf("Would you like to play with a computer? (y/n) \n");
-
-    char computer = '\0';
-    while(true) {
-        if (fgets(line, sizeof(line), stdin)) {
-            if (sscanf(line, "%c", &computer) == 1) {
-                if (computer == 'Y' || computer == 'N' || computer == 'y' || computer == 'n') {
-                    break;
-                } 
-            } 
-            //Error input
-            printf("Please input either y or n.\n");
-        }
-    }
-    //Loop with two human players
-    if (computer == 'n' || computer == 'N') {
-        while(true) {
-            printf("Current grid: \n");
-            print_grid(bpt);
-            printf("It's player %s's turn! Make a move. \n", player_to_string(current_player));
-            if (fgets(line, sizeof(line), stdin)) {
-                if (sscanf(line, "%d %d", &move_x, &move_y) == 2 && get(bpt, move_x, move_y) == EMPTY) {
-                    move(bpt, move_x, move_y);
-                    //Switches current player
-                
-                    //Here are the end states:
-                    if (is_winning_move(bpt, move_x, move_y)) {
-                        printf("Player %s won! \n", player_to_string(current_player));
-                        print_grid(bpt);
-                        break;
-                    } else if (is_full(bpt)) {
-                        printf("It's a draw!\n");
-                        print_grid(bpt);
-                        break;
-                    }
-                    //Advances current player
-                    current_player = BOARD.player;
-                    continue;
-                } else {
-
-                    printf("Illegal move or failed read. Enter a move as x y, with 0<=x,y<=3.\n");
-                }
-            } else {
-                printf("Failed to read line. Enter a move as x y, with 0<=x,y<=3.\n");
-            }
-        }
-    } 
-
-    //Loop to play with computer
-    else {
-
-        GridStateMap MAP;
-        GridStateMap* mpt = init_map(&MAP); //Initializes the map
-
-        //Asks to go first or second
-
-        int response = 0;
-        Player computer_player = EMPTY;
-
-        printf("Would you like to go first or second? (1/2)\n");
-        while(true) {
-            if (fgets(line, sizeof(line), stdin)) {
-                if (sscanf(line, "%d ", &response) == 1) {
-                    if (response == 1) {
-                        computer_player = O_PL;
-                        break;
-                    } else if (response == 2) {
-                        computer_player = X_PL;
-                        break;
-                    }
-                }
-                printf("Please input either 1 or 2\n");
-            }
-        }
-
-        //Print the empty board once:
-        //Always take the center if possible
-        if (computer_player == X_PL) {
-            printf("Current grid: \n");
-            print_grid(bpt);
-            move(bpt, 1, 1);
-        }
-        //Populates the map.
-        calculate_position(mpt, bpt);
-        while(true) {
-            printf("Current grid: \n");
-            print_grid(bpt);
-            printf("It's your turn! Make a move. \n");
-            if (fgets(line, sizeof(line), stdin)) {
-                if (sscanf(line, "%d %d", &move_x, &move_y) == 2 && get(bpt, move_x, move_y) == EMPTY) {
-                    move(bpt, move_x, move_y);
-                    printf("Current grid: \n");
-                    print_grid(bpt);
-                    //Here are the end states:
-                    if (is_winning_move(bpt, move_x, move_y)) {
-                        printf("You won! \n");
-                        print_grid(bpt);
-                        break;
-                    } else if (is_full(bpt)) {
-                        printf("It's a draw!\n");
-                        print_grid(bpt);
-                        break;
-                    }
-
-                    //Find computer move now
-                    size_t move = best_move_from_map(mpt, bpt);
-                    if (!(move < GRID_TOTAL)) {
-                        printf("Error, lookup failed.");
-                        return EXIT_FAILURE;
-                    }
-                    BOARD.data[move] = current_player;
-                    BOARD.player = next_player(BOARD.player);
-
-                    if (has_won(bpt)) {
-                        printf("You lost!");
-                        print_grid(bpt);
-                        break;
-                    } else if (is_full(bpt)) {
-                        printf("It's a draw!\n");
-                        print_grid(bpt);
-                        break;
-                    }
-                    continue;
-                } 
-            } 
-            printf("Failed to read line. Enter a move as x y, with 0<=x,y<=3.\n");
-        }
-
-
-
-
-
-    }
-    return EXIT_SUCCESS;
-    
-}
-
+//Tic tac toe game, with an algorithmic opponent
+
+#include<assert.h>
+#include<errno.h>
+#include<math.h>
+#include<stdalign.h>
+#include<stdatomic.h>
+#include<stddef.h>
+#include<stdint.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+
+//The solution database is mapped into memory where we can, and read in otherwise.
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#else
+#define HAVE_MMAP 0
+#endif
+
+//The layered solver spreads its work over C11 threads when the library has them, and runs on one thread otherwise.
+#ifndef __STDC_NO_THREADS__
+#define HAVE_THREADS 1
+#include<threads.h>
+#else
+#define HAVE_THREADS 0
+#endif
+
+//The batch win checks have SSE2 and AVX2 versions on x86, picked when the program starts.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include<immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+//The board is GRID_X_DIM by GRID_Y_DIM, and GRID_K in a row wins.
+//These are fixed at compile time, eg. -DGRID_X_DIM=4 -DGRID_Y_DIM=4 -DGRID_K=4,
+//so every board size gets its own constant folded kernels.
+#ifndef GRID_X_DIM
+#define GRID_X_DIM 3
+#endif
+#ifndef GRID_Y_DIM
+#define GRID_Y_DIM 3
+#endif
+#ifndef GRID_K
+#define GRID_K 3
+#endif
+
+#define GRID_TOTAL (GRID_X_DIM * GRID_Y_DIM)
+
+//Boards up to this many tiles are solved exhaustively, with a table slot for every board.
+#define DENSE_MAX_TILES 16
+#define GRID_DENSE (GRID_TOTAL <= DENSE_MAX_TILES)
+
+static_assert(GRID_X_DIM >= 2 && GRID_Y_DIM >= 2, "The board needs at least 2 rows and columns");
+static_assert(GRID_K >= 2 && GRID_K <= GRID_X_DIM && GRID_K <= GRID_Y_DIM, "GRID_K has to fit on the board");
+static_assert(GRID_TOTAL <= 64, "Bitboards hold at most 64 tiles");
+
+enum {
+    LINE_MAX = 256,
+};
+
+//The number of lines of GRID_K tiles on the board.
+enum {
+    GRID_LINES = GRID_Y_DIM * (GRID_X_DIM - GRID_K + 1) //Rows
+        + GRID_X_DIM * (GRID_Y_DIM - GRID_K + 1) //Columns
+        + 2 * (GRID_X_DIM - GRID_K + 1) * (GRID_Y_DIM - GRID_K + 1), //Diagonals
+};
+
+//At most GRID_K lines go through a tile in each of the 4 directions.
+enum {
+    TILE_LINES_MAX = 4 * GRID_K,
+};
+
+typedef enum Tile Tile;
+
+enum Tile {
+    EMPTY = 0,
+    X_PL = 1,
+    O_PL = 2,
+    TOTAL_TILES = 3, //Error condition return as well. 
+};
+
+//this is just a switch case
+//returns the null character on error. 
+
+char const tile_to_char(Tile const t) {
+    switch (t) {
+    case EMPTY: 
+        return 'E';
+    case X_PL:
+        return 'X';
+    case O_PL:
+        return 'O';
+    default:
+        return '\0';
+    }
+}
+//We use tiles to keep track of the current player as well. 
+//X is the starting player by default
+//Player uses EMPTY and TOTAL_TILES as error states
+
+typedef Tile Player;
+char const * const player_to_string(Player const p) {
+    switch (p) {
+    case X_PL:
+        return "Player X";
+    case O_PL:
+        return "Player O";
+    default:
+        return "Error, no current player";
+    }
+}
+
+Player next_player(Player p) {
+    switch (p) {
+    case X_PL:
+        return O_PL;
+    case O_PL:
+        return X_PL;
+    default:
+        return EMPTY;
+    }
+}
+
+//This is just a wrapper around a grid.
+
+//We access using x, y coordinates, 0 <= x < GRID_X_DIM, 0 <= y < GRID_Y_DIM.
+
+//Contains the world state
+
+//A set of tiles, bit i is the tile at index i. Grids keep one per side, see BitGrid below.
+#if GRID_TOTAL <= 16
+typedef uint16_t BitMask;
+#elif GRID_TOTAL <= 32
+typedef uint32_t BitMask;
+#else
+typedef uint64_t BitMask;
+#endif
+
+typedef struct Grid Grid;
+//Has grid data and turn
+//key is the Zobrist hash of the board: the XOR of a random number for every piece,
+//plus one for O to move. It is kept up to date by set, move and unmove,
+//so tables can use it without rescanning the board.
+//So are the piece counts, which make has_won, is_full and is_winning_move constant time:
+//a line is won when one side has GRID_K pieces on it.
+//And so are the tiles of each side, so the bitboard solvers can take the board without rescanning it.
+struct Grid {
+    Tile data [GRID_TOTAL];
+    Player player;
+    uint64_t key;
+    BitMask tiles[2]; //X's ([0]) and O's ([1]) tiles
+    uint8_t line_pieces[2][GRID_LINES]; //X's ([0]) and O's ([1]) pieces on each line
+    uint16_t lines_won[2]; //Lines full of X's and of O's
+    uint8_t pieces; //Pieces on the board
+};
+
+//ZOBRIST[t][i] is the key of tile t on index i, EMPTY is all 0.
+//Filled by init_tables, keys are only meaningful after that.
+static uint64_t ZOBRIST[TOTAL_TILES][GRID_TOTAL];
+static uint64_t ZOBRIST_O_TURN;
+
+//The lines through each tile, as indexes into LINE_MASKS. Filled by init_tables.
+static uint16_t TILE_LINES[GRID_TOTAL][TILE_LINES_MAX];
+static uint8_t TILE_LINE_COUNT[GRID_TOTAL];
+
+Grid* reset(Grid* g) {
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        g->data[i] = EMPTY;
+    }
+    g->player = X_PL;
+    g->key = 0;
+    g->tiles[0] = 0;
+    g->tiles[1] = 0;
+    memset(g->line_pieces, 0, sizeof(g->line_pieces));
+    g->lines_won[0] = 0;
+    g->lines_won[1] = 0;
+    g->pieces = 0;
+    return g;
+}
+
+Grid* init_new_grid() {
+    Grid *p = malloc(sizeof(Grid));
+    reset(p);
+    return p;
+}
+
+size_t get_index (size_t x, size_t y) {
+    return y*GRID_X_DIM + x;
+}
+
+//Returns TOTAL if out of bounds error
+Tile get(Grid const* g, size_t x, size_t y) {
+    if (x < GRID_X_DIM && y < GRID_Y_DIM) {
+        return g->data[get_index(x, y)];
+    }
+    else {
+        return TOTAL_TILES;
+    }
+}
+
+//Tiles are copyable, do not need pointers
+//Returns TOTAL if out of bounds
+Tile set(Grid* g, size_t x, size_t y, Tile t) {
+    if (x < GRID_X_DIM && y < GRID_Y_DIM && t < TOTAL_TILES) {
+        size_t const i = get_index(x, y);
+        Tile const old = g->data[i];
+        g->key ^= ZOBRIST[old][i] ^ ZOBRIST[t][i];
+        g->data[i] = t;
+        //Take the old piece off its lines, and put the new one on.
+        if (old != EMPTY) {
+            for (size_t j = 0; j < TILE_LINE_COUNT[i]; j++) {
+                g->lines_won[old - X_PL] -= g->line_pieces[old - X_PL][TILE_LINES[i][j]]-- == GRID_K;
+            }
+            g->tiles[old - X_PL] &= ~((BitMask) 1 << i);
+            g->pieces--;
+        }
+        if (t != EMPTY) {
+            for (size_t j = 0; j < TILE_LINE_COUNT[i]; j++) {
+                g->lines_won[t - X_PL] += ++g->line_pieces[t - X_PL][TILE_LINES[i][j]] == GRID_K;
+            }
+            g->tiles[t - X_PL] |= (BitMask) 1 << i;
+            g->pieces++;
+        }
+        return t;
+    }
+    else {
+        return TOTAL_TILES;
+    }
+}
+
+//RETURNS TOTAL_TILES on failure, ie if the spot at x, y was already taken.
+Tile move(Grid* g, size_t x, size_t y) {
+    Tile ret = TOTAL_TILES;
+    if (get(g, x, y) == EMPTY) {
+        ret = set(g, x, y, g->player);
+        g->player = next_player(g->player);
+        g->key ^= ZOBRIST_O_TURN;
+    }
+    return ret;
+}
+
+//Takes back the move at x, y, so it is that player's turn again.
+//RETURNS TOTAL_TILES on failure, ie if the spot at x, y was empty.
+Tile unmove(Grid* g, size_t x, size_t y) {
+    Tile const ret = get(g, x, y);
+    if (ret == EMPTY || ret == TOTAL_TILES) {
+        return TOTAL_TILES;
+    }
+    set(g, x, y, EMPTY);
+    if (g->player != ret) {
+        g->player = ret;
+        g->key ^= ZOBRIST_O_TURN;
+    }
+    return ret;
+}
+
+//Doesn't check errors, prints empty character on error. 
+void print_grid(Grid const * const g) {
+    char current = 'E';
+    printf("Current turn: %s\n", player_to_string(g->player));
+    for (size_t y = 0; y < GRID_Y_DIM; y++) {
+        for (size_t x = 0; x < GRID_X_DIM; x++) {
+            current = tile_to_char(g->data[get_index(x,y)]);
+            printf("%c ", current);
+            //May print '\0' which is empty?
+            //THIS MIGHT BE A BUG, NOT QUITE SURE
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+//Copies without allocation
+Grid* copy_grid_into(Grid const* const p1, Grid* p2) {
+    if (p2) {
+        *p2 = *p1;
+    }
+    return p2;
+}
+//Copies with allocation
+//Returns null on failure. 
+Grid* copy(Grid const * const p) {
+    return copy_grid_into(p, malloc(sizeof(Grid)));
+}
+
+void destroy(Grid* g) {
+    free(g);
+}
+
+bool equals(Grid const * const g1, Grid const * const g2) {
+    if (g1 && g2) {
+        if (g1->player != g2->player || g1->key != g2->key) {
+            return false;
+        }
+        for (size_t i = 0; i < GRID_TOTAL; i++) {
+            if (g1->data[i] != g2->data[i]) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+//Bitboard version of the grid, used by the solver.
+
+//Bit i of a mask is the tile at index i, same as get_index.
+//A position is two occupancy masks plus the side to move,
+//so copies and comparisons are a couple of integer ops.
+
+typedef struct BitGrid BitGrid;
+struct BitGrid {
+    BitMask x; //Tiles held by X
+    BitMask o; //Tiles held by O
+    bool o_turn; //Side to move, false when X is to move
+};
+
+#define FULL_MASK ((BitMask) ((BitMask) -1 >> (8 * sizeof(BitMask) - GRID_TOTAL)))
+
+//Tiles where a line can start, for each direction.
+//The first column, times a run of bits, gives those columns in every row.
+static BitMask const FIRST_COLUMN = FULL_MASK / (((BitMask) 1 << GRID_X_DIM) - 1);
+static BitMask const LEFT_STARTS = FIRST_COLUMN * (((BitMask) 1 << (GRID_X_DIM - GRID_K + 1)) - 1);
+static BitMask const RIGHT_STARTS = LEFT_STARTS << (GRID_K - 1);
+static BitMask const TOP_STARTS = FULL_MASK >> ((GRID_K - 1) * GRID_X_DIM);
+
+//Every line on the board as a mask, and the tiles ordered by how many lines go through them.
+//Filled by init_tables.
+static BitMask LINE_MASKS[GRID_LINES];
+static uint8_t TILE_ORDER[GRID_TOTAL];
+
+//Constant time, set keeps the grid's tiles up to date.
+BitGrid bitgrid_from_grid(Grid const * const g) {
+    return (BitGrid) {g->tiles[0], g->tiles[1], g->player == O_PL};
+}
+
+//The Zobrist key of b, worked out from scratch. Grids keep theirs up to date instead.
+uint64_t bitgrid_key(BitGrid const b) {
+    uint64_t key = b.o_turn ? ZOBRIST_O_TURN : 0;
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        if (b.x & ((BitMask) 1 << i)) {
+            key ^= ZOBRIST[X_PL][i];
+        } else if (b.o & ((BitMask) 1 << i)) {
+            key ^= ZOBRIST[O_PL][i];
+        }
+    }
+    return key;
+}
+
+//Goes through set, so the key and the counts are right too.
+Grid* bitgrid_to_grid(BitGrid const b, Grid* g) {
+    reset(g);
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        if (b.x & ((BitMask) 1 << i)) {
+            set(g, i % GRID_X_DIM, i / GRID_X_DIM, X_PL);
+        } else if (b.o & ((BitMask) 1 << i)) {
+            set(g, i % GRID_X_DIM, i / GRID_X_DIM, O_PL);
+        }
+    }
+    if (b.o_turn) {
+        g->player = O_PL;
+        g->key ^= ZOBRIST_O_TURN;
+    }
+    return g;
+}
+
+bool bitgrid_equals(BitGrid const b1, BitGrid const b2) {
+    return b1.x == b2.x && b1.o == b2.o && b1.o_turn == b2.o_turn;
+}
+
+Player bitgrid_player(BitGrid const b) {
+    return b.o_turn ? O_PL : X_PL;
+}
+
+//True if the occupancy mask covers any full line.
+//A bit survives the shifts if the next GRID_K - 1 tiles in that direction are set too,
+//so it marks the start of a line. The shifts and masks are all constants,
+//so the compiler unrolls this into a fixed sequence for each board size.
+bool mask_has_line(BitMask const m) {
+    BitMask across = m;
+    BitMask down = m;
+    BitMask diagonal = m;
+    BitMask anti_diagonal = m;
+    for (size_t j = 1; j < GRID_K; j++) {
+        across &= m >> j;
+        down &= m >> (j * GRID_X_DIM);
+        diagonal &= m >> (j * (GRID_X_DIM + 1));
+        anti_diagonal &= m >> (j * (GRID_X_DIM - 1));
+    }
+    return (across & LEFT_STARTS)
+        | (down & TOP_STARTS)
+        | (diagonal & LEFT_STARTS & TOP_STARTS)
+        | (anti_diagonal & RIGHT_STARTS & TOP_STARTS);
+}
+
+//Same contract as has_won.
+Player bitgrid_has_won(BitGrid const b) {
+    if (mask_has_line(b.x)) {
+        return X_PL;
+    } else if (mask_has_line(b.o)) {
+        return O_PL;
+    }
+    return EMPTY;
+}
+
+BitMask bitgrid_empty(BitGrid const b) {
+    return ~(b.x | b.o) & FULL_MASK;
+}
+
+bool bitgrid_is_full(BitGrid const b) {
+    return (b.x | b.o) == FULL_MASK;
+}
+
+//Plays the side to move on tile i, which must be empty.
+BitGrid bitgrid_move(BitGrid b, size_t i) {
+    if (b.o_turn) {
+        b.o |= (BitMask) 1 << i;
+    } else {
+        b.x |= (BitMask) 1 << i;
+    }
+    b.o_turn = !b.o_turn;
+    return b;
+}
+
+//True if every line has pieces from both sides, so nobody can win any more.
+bool bitgrid_is_dead(BitGrid const b) {
+    for (size_t l = 0; l < GRID_LINES; l++) {
+        if (!(LINE_MASKS[l] & b.x) || !(LINE_MASKS[l] & b.o)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Index of the lowest set bit, m must not be 0.
+//Loop over the moves with: for (m = empty; m; m &= m - 1) lowest_tile(m)
+size_t lowest_tile(BitMask const m) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(m);
+#else
+    size_t i = 0;
+    while (!(m & ((BitMask) 1 << i))) {
+        i++;
+    }
+    return i;
+#endif
+}
+
+//Number of set bits in m, which can be a BitMask or any other word.
+size_t count_tiles(uint64_t const m) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(m);
+#else
+    size_t count = 0;
+    for (uint64_t iter = m; iter; iter &= iter - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+//Empty tiles where a piece for p would complete a line.
+BitMask bitgrid_threats(BitGrid const b, Player const p) {
+    BitMask const mine = p == X_PL ? b.x : b.o;
+    BitMask const theirs = p == X_PL ? b.o : b.x;
+    BitMask threats = 0;
+    for (size_t l = 0; l < GRID_LINES; l++) {
+        if (!(LINE_MASKS[l] & theirs) && count_tiles(LINE_MASKS[l] & mine) == GRID_K - 1) {
+            threats |= LINE_MASKS[l] & ~mine;
+        }
+    }
+    return threats;
+}
+
+//Checks if the last move played at x, y is a winning move. 
+//Only the lines through x, y can have been completed by it.
+bool is_winning_move(Grid const * const g, size_t x, size_t y) {
+    Player maybe_winner = get(g, x, y);
+    //First checks if the move was possible
+    if (maybe_winner == EMPTY || maybe_winner == TOTAL_TILES) {
+        return false;
+    }
+    size_t const i = get_index(x, y);
+    for (size_t j = 0; j < TILE_LINE_COUNT[i]; j++) {
+        if (g->line_pieces[maybe_winner - X_PL][TILE_LINES[i][j]] == GRID_K) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//Returns the player with a full line, or EMPTY.
+Player has_won(Grid const * const g) {
+    if (g->lines_won[0]) {
+        return X_PL;
+    } else if (g->lines_won[1]) {
+        return O_PL;
+    }
+    return EMPTY;
+}
+
+//Returns empty if no one has won yet.
+/*
+Player has_won(Grid const * const g) {
+    //Checks including 1, 1
+    
+    if (is_winning_move(g, 1, 1)) {
+        return get(g, 1, 1);
+    } else {
+        //Check vert and horizontal at 0,0 and 2,2
+        
+        Player pot_winner = get(g, 0, 0);
+
+        if (pot_winner != EMPTY) {
+            bool horizontal_win = true;
+            for (size_t i = 0; i < GRID_X_DIM; i++) {
+                if (get(g, i, 0) != pot_winner) {
+                    horizontal_win = false;
+                    break;
+                }
+            }
+            if (horizontal_win) {
+                return pot_winner;
+            }
+            bool vertical_win = true;
+            for (size_t j = 0; j < GRID_Y_DIM; j++) {
+                if (get(g, 0, j) != pot_winner) {
+                    vertical_win = false;
+                    break;
+                }
+            } 
+            if (vertical_win) {
+                return pot_winner;
+            }
+        } else {
+            pot_winner = get(g, 2, 2);
+            bool horizontal_win = true;
+            for (size_t i = 0; i < GRID_X_DIM; i++) {
+                if (get(g, i, 2) != pot_winner) {
+                    horizontal_win = false;
+                    break;
+                }
+            }
+            if (horizontal_win) {
+                return pot_winner;
+            }
+            bool vertical_win = true;
+            for (size_t j = 0; j < GRID_Y_DIM; j++) {
+                if (get(g, 2, j) != pot_winner) {
+                    vertical_win = false;
+                    break;
+                }
+            } 
+            if (vertical_win) {
+                return pot_winner;
+            }
+        }
+        return EMPTY;
+    }
+}
+*/
+bool is_full(Grid const * const g) {
+    return g->pieces == GRID_TOTAL;
+}
+
+//Solver statistics, for seeing where a slow solve spends its time.
+//They are only compiled in with -DSOLVER_STATS. Otherwise the STAT_ macros are empty, and cost nothing.
+//The counters are atomic, so the layered solver's threads can all add to them.
+
+typedef enum StatPhase StatPhase;
+enum StatPhase {
+    PHASE_SEARCH = 0, //The breadth first search
+    PHASE_FORWARD = 1, //Finding the reachable positions, for the retrograde and layered solvers
+    PHASE_BACKWARD = 2, //Solving them
+    TOTAL_PHASES = 3,
+};
+
+#ifdef SOLVER_STATS
+typedef struct SolverStats SolverStats;
+struct SolverStats {
+    atomic_ullong probes; //Table reads
+    atomic_ullong hits; //Table reads that found a solved position
+    atomic_ullong inserts; //Table writes
+    atomic_ullong expanded; //Positions whose children were generated
+    atomic_ullong requeued; //Positions the breadth first search had to come back to
+    atomic_ullong allocations;
+    atomic_ullong allocated_bytes;
+    double phase_time[TOTAL_PHASES]; //Seconds, only added to by one thread
+};
+
+static SolverStats STATS;
+
+#define STAT_ADD(counter, n) atomic_fetch_add_explicit(&STATS.counter, (n), memory_order_relaxed)
+#define STAT_ALLOC(bytes) (STAT_ADD(allocations, 1), STAT_ADD(allocated_bytes, (bytes)))
+#define STAT_CLOCK(begin) double const begin = seconds_now()
+#define STAT_PHASE(phase, begin) (STATS.phase_time[phase] += seconds_now() - (begin))
+#else
+#define STAT_ADD(counter, n) ((void) 0)
+#define STAT_ALLOC(bytes) ((void) 0)
+#define STAT_CLOCK(begin) ((void) 0)
+#define STAT_PHASE(phase, begin) ((void) 0)
+#endif
+
+//Bump allocator for the solver's memory.
+//Allocations are carved from large blocks and are only released all at once.
+
+enum {
+    ARENA_BLOCK_SIZE = 1 << 16,
+};
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+    ArenaBlock* next; //Older blocks
+    size_t size; //Usable bytes in data
+    size_t used;
+    max_align_t data[];
+};
+
+typedef struct Arena Arena;
+struct Arena {
+    ArenaBlock* head; //Block we're allocating from
+    size_t reserved; //Bytes held by all the blocks
+};
+
+Arena* init_arena(Arena* a) {
+    if (a) {
+        a->head = nullptr;
+        a->reserved = 0;
+    }
+    return a;
+}
+
+//Returns memory aligned for any type, or null on allocation error.
+void* arena_alloc(Arena* a, size_t bytes) {
+    size_t const align = alignof(max_align_t);
+    bytes = (bytes + align - 1) / align * align;
+    ArenaBlock* block = a->head;
+    if (!block || block->size - block->used < bytes) {
+        //Big requests get their own block
+        size_t const size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+        if (!(block = malloc(sizeof(ArenaBlock) + size))) {
+            return nullptr;
+        }
+        STAT_ALLOC(sizeof(ArenaBlock) + size);
+        block->size = size;
+        block->used = 0;
+        block->next = a->head;
+        a->head = block;
+        a->reserved += size;
+    }
+    void* ret = (char*) block->data + block->used;
+    block->used += bytes;
+    return ret;
+}
+
+//Frees every block but the largest one, which is kept empty for reuse.
+void arena_reset(Arena* a) {
+    ArenaBlock* keep = nullptr;
+    ArenaBlock* iter = a->head;
+    while (iter != nullptr) {
+        ArenaBlock* next = iter->next;
+        if (!keep || iter->size > keep->size) {
+            free(keep);
+            keep = iter;
+        } else {
+            free(iter);
+        }
+        iter = next;
+    }
+    if (keep) {
+        keep->used = 0;
+        keep->next = nullptr;
+    }
+    a->head = keep;
+    a->reserved = keep ? keep->size : 0;
+}
+
+void destroy_arena(Arena* a) {
+    arena_reset(a);
+    free(a->head);
+    init_arena(a);
+}
+
+//Growable ring buffer of positions, used as the solver's work queue.
+//Positions are held by value, so pushing and popping never allocates
+//except when the buffer has to grow.
+
+typedef struct PositionQueue PositionQueue;
+struct PositionQueue {
+    BitGrid* data;
+    size_t capacity; //Always 0 or a power of two
+    size_t head; //Index of the front
+    size_t size;
+    size_t peak; //Largest size since the last clear
+};
+
+PositionQueue* init_queue(PositionQueue* q) {
+    if (q) {
+        q->data = nullptr;
+        q->capacity = 0;
+        q->head = 0;
+        q->size = 0;
+        q->peak = 0;
+    }
+    return q;
+}
+
+//Empties the queue, keeping its buffer.
+void clear_queue(PositionQueue* q) {
+    q->head = 0;
+    q->size = 0;
+    q->peak = 0;
+}
+
+void destroy_queue(PositionQueue* q) {
+    free(q->data);
+    init_queue(q);
+}
+
+//Returns false on allocation error.
+bool queue_push(PositionQueue* q, BitGrid const g) {
+    if (q->size == q->capacity) {
+        size_t const new_capacity = q->capacity ? 2 * q->capacity : 256;
+        BitGrid* grown = realloc(q->data, new_capacity * sizeof(BitGrid));
+        if (!grown) {
+            return false;
+        }
+        STAT_ALLOC(new_capacity * sizeof(BitGrid));
+        //Unwrap: the part that was at the start of the buffer goes after the old end.
+        for (size_t i = 0; i < q->head; i++) {
+            grown[q->capacity + i] = grown[i];
+        }
+        q->data = grown;
+        q->capacity = new_capacity;
+    }
+    q->data[(q->head + q->size) & (q->capacity - 1)] = g;
+    q->size++;
+    if (q->size > q->peak) {
+        q->peak = q->size;
+    }
+    return true;
+}
+
+//Returns false if the queue is empty.
+bool queue_pop(PositionQueue* q, BitGrid* g) {
+    if (q->size == 0) {
+        return false;
+    }
+    *g = q->data[q->head];
+    q->head = (q->head + 1) & (q->capacity - 1);
+    q->size--;
+    return true;
+}
+
+
+/*
+typedef struct GameTree GameTree;
+struct GameTree {
+    Grid const* current_grid;
+    GridList* possible_moves; //List of next values
+    size_t empty_tiles; //is the same as the size of possible moves.
+    Player player;
+};
+
+//This consumes the pointer, do not use current_grid afterwards
+GameTree* init(Grid const* current_grid, Player player) {
+    GameTree *ret = malloc(sizeof(GameTree));
+
+    ret->current_grid = current_grid;
+    ret->player = player;
+    ret->possible_moves = find_possible_moves(current_grid, player);
+    return ret;
+}
+*/
+//Keeps track of state 
+
+//Has the same ordering as Tile and Player
+//UNKNOWN = EMPTY 
+//X_WIN = X_PL
+//O_WIN = O_PL
+//DRAW == TOTAL
+enum WinState {
+    UNKNOWN = 0, // Sentinel value
+    X_WIN = 1,
+    O_WIN = 2,
+    DRAW = 4,
+};
+
+typedef enum WinState WinState;
+
+char const * const state_to_string(WinState state) {
+    switch (state) {
+    case X_WIN:
+        return "X wins";
+    case O_WIN:
+        return "O wins";
+    case DRAW:
+        return "Draw";
+    default:
+        return "Win state unknown";
+    }
+} 
+
+//Wall clock time in seconds
+double seconds_now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+enum {
+    THREADS_MAX = 1024, //The most --threads can ask for
+};
+
+size_t core_count() {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long const count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#else
+    return 1;
+#endif
+}
+
+//The threads to run for a thread count setting: 0 is one per core, and it's 1 without thread support.
+size_t thread_count(size_t threads) {
+#if HAVE_THREADS
+    return threads ? threads : core_count();
+#else
+    (void) threads;
+    return 1;
+#endif
+}
+
+//Batch win checks: the results of many boards at once, for callers that have lots of independent positions.
+//The boards come as two arrays, the X and the O tiles of each one. Each result is X_WIN or O_WIN
+//if that side has a line (X first, like bitgrid_has_won), DRAW if the board is full otherwise,
+//and UNKNOWN if the game isn't over.
+//The vector versions check a register full of boards at once: 8 with SSE2 and 16 with AVX2
+//for boards of up to 16 tiles, half that for up to 32, and a quarter for up to 64.
+typedef void (*WinnersFn)(BitMask const * const xs, BitMask const * const os, size_t count, uint8_t* results);
+
+void winners_scalar(BitMask const * const xs, BitMask const * const os, size_t count, uint8_t* results) {
+    for (size_t i = 0; i < count; i++) {
+        BitGrid const b = {xs[i], os[i], false};
+        Player const winner = bitgrid_has_won(b);
+        results[i] = winner != EMPTY ? (WinState) winner : bitgrid_is_full(b) ? DRAW : UNKNOWN;
+    }
+}
+
+#if HAVE_X86_SIMD
+//The same shifts as mask_has_line, on a register of boards: a lane survives a direction's shifts
+//where the next GRID_K - 1 tiles are set too. The lane width follows BitMask.
+#if GRID_TOTAL <= 16
+#define SSE2_SET1(m) _mm_set1_epi16((short) (m))
+#define SSE2_SHIFT(a, n) _mm_srli_epi16(a, n)
+#define SSE2_CMPEQ(a, b) _mm_cmpeq_epi16(a, b)
+#define AVX2_SET1(m) _mm256_set1_epi16((short) (m))
+#define AVX2_SHIFT(a, n) _mm256_srli_epi16(a, n)
+#define AVX2_CMPEQ(a, b) _mm256_cmpeq_epi16(a, b)
+#elif GRID_TOTAL <= 32
+#define SSE2_SET1(m) _mm_set1_epi32((int) (m))
+#define SSE2_SHIFT(a, n) _mm_srli_epi32(a, n)
+#define SSE2_CMPEQ(a, b) _mm_cmpeq_epi32(a, b)
+#define AVX2_SET1(m) _mm256_set1_epi32((int) (m))
+#define AVX2_SHIFT(a, n) _mm256_srli_epi32(a, n)
+#define AVX2_CMPEQ(a, b) _mm256_cmpeq_epi32(a, b)
+#else
+//SSE2 has no 64 bit compare, so that one is built from the 32 bit halves.
+#define SSE2_SET1(m) _mm_set1_epi64x((long long) (m))
+#define SSE2_SHIFT(a, n) _mm_srli_epi64(a, n)
+#define SSE2_CMPEQ(a, b) sse2_cmpeq_epi64(a, b)
+#define AVX2_SET1(m) _mm256_set1_epi64x((long long) (m))
+#define AVX2_SHIFT(a, n) _mm256_srli_epi64(a, n)
+#define AVX2_CMPEQ(a, b) _mm256_cmpeq_epi64(a, b)
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_cmpeq_epi64(__m128i const a, __m128i const b) {
+    __m128i const halves = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+#endif
+
+//All ones in the lanes of m that cover a line.
+__attribute__((target("sse2")))
+static inline __m128i sse2_has_line(__m128i const m) {
+    __m128i across = m;
+    __m128i down = m;
+    __m128i diagonal = m;
+    __m128i anti_diagonal = m;
+    for (int j = 1; j < GRID_K; j++) {
+        across = _mm_and_si128(across, SSE2_SHIFT(m, j));
+        down = _mm_and_si128(down, SSE2_SHIFT(m, j * GRID_X_DIM));
+        diagonal = _mm_and_si128(diagonal, SSE2_SHIFT(m, j * (GRID_X_DIM + 1)));
+        anti_diagonal = _mm_and_si128(anti_diagonal, SSE2_SHIFT(m, j * (GRID_X_DIM - 1)));
+    }
+    __m128i const starts = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(across, SSE2_SET1(LEFT_STARTS)), _mm_and_si128(down, SSE2_SET1(TOP_STARTS))),
+        _mm_or_si128(_mm_and_si128(diagonal, SSE2_SET1(LEFT_STARTS & TOP_STARTS)),
+            _mm_and_si128(anti_diagonal, SSE2_SET1(RIGHT_STARTS & TOP_STARTS))));
+    return _mm_andnot_si128(SSE2_CMPEQ(starts, _mm_setzero_si128()), SSE2_SET1(-1));
+}
+
+__attribute__((target("sse2")))
+void winners_sse2(BitMask const * const xs, BitMask const * const os, size_t count, uint8_t* results) {
+    enum { LANES = sizeof(__m128i) / sizeof(BitMask) };
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m128i const x = _mm_loadu_si128((__m128i const *) &xs[i]);
+        __m128i const o = _mm_loadu_si128((__m128i const *) &os[i]);
+        __m128i const x_won = sse2_has_line(x);
+        __m128i const o_won = sse2_has_line(o);
+        __m128i const full = SSE2_CMPEQ(_mm_or_si128(x, o), SSE2_SET1(FULL_MASK));
+        __m128i states = _mm_and_si128(x_won, SSE2_SET1(X_WIN));
+        states = _mm_or_si128(states, _mm_andnot_si128(x_won, _mm_and_si128(o_won, SSE2_SET1(O_WIN))));
+        states = _mm_or_si128(states, _mm_andnot_si128(_mm_or_si128(x_won, o_won), _mm_and_si128(full, SSE2_SET1(DRAW))));
+        BitMask lanes[LANES];
+        _mm_storeu_si128((__m128i*) lanes, states);
+        for (size_t j = 0; j < LANES; j++) {
+            results[i + j] = (uint8_t) lanes[j];
+        }
+    }
+    winners_scalar(xs + i, os + i, count - i, results + i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_has_line(__m256i const m) {
+    __m256i across = m;
+    __m256i down = m;
+    __m256i diagonal = m;
+    __m256i anti_diagonal = m;
+    for (int j = 1; j < GRID_K; j++) {
+        across = _mm256_and_si256(across, AVX2_SHIFT(m, j));
+        down = _mm256_and_si256(down, AVX2_SHIFT(m, j * GRID_X_DIM));
+        diagonal = _mm256_and_si256(diagonal, AVX2_SHIFT(m, j * (GRID_X_DIM + 1)));
+        anti_diagonal = _mm256_and_si256(anti_diagonal, AVX2_SHIFT(m, j * (GRID_X_DIM - 1)));
+    }
+    __m256i const starts = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(across, AVX2_SET1(LEFT_STARTS)), _mm256_and_si256(down, AVX2_SET1(TOP_STARTS))),
+        _mm256_or_si256(_mm256_and_si256(diagonal, AVX2_SET1(LEFT_STARTS & TOP_STARTS)),
+            _mm256_and_si256(anti_diagonal, AVX2_SET1(RIGHT_STARTS & TOP_STARTS))));
+    return _mm256_andnot_si256(AVX2_CMPEQ(starts, _mm256_setzero_si256()), AVX2_SET1(-1));
+}
+
+__attribute__((target("avx2")))
+void winners_avx2(BitMask const * const xs, BitMask const * const os, size_t count, uint8_t* results) {
+    enum { LANES = sizeof(__m256i) / sizeof(BitMask) };
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i const x = _mm256_loadu_si256((__m256i const *) &xs[i]);
+        __m256i const o = _mm256_loadu_si256((__m256i const *) &os[i]);
+        __m256i const x_won = avx2_has_line(x);
+        __m256i const o_won = avx2_has_line(o);
+        __m256i const full = AVX2_CMPEQ(_mm256_or_si256(x, o), AVX2_SET1(FULL_MASK));
+        __m256i states = _mm256_and_si256(x_won, AVX2_SET1(X_WIN));
+        states = _mm256_or_si256(states, _mm256_andnot_si256(x_won, _mm256_and_si256(o_won, AVX2_SET1(O_WIN))));
+        states = _mm256_or_si256(states,
+            _mm256_andnot_si256(_mm256_or_si256(x_won, o_won), _mm256_and_si256(full, AVX2_SET1(DRAW))));
+        BitMask lanes[LANES];
+        _mm256_storeu_si256((__m256i*) lanes, states);
+        for (size_t j = 0; j < LANES; j++) {
+            results[i + j] = (uint8_t) lanes[j];
+        }
+    }
+    winners_scalar(xs + i, os + i, count - i, results + i);
+}
+#endif
+
+//The fastest version this processor has, and its name.
+WinnersFn best_winners(char const ** name) {
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return winners_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return winners_sse2;
+    }
+#endif
+    *name = "scalar";
+    return winners_scalar;
+}
+
+//The version bitgrid_winners uses, set by init_tables.
+static WinnersFn WINNERS = winners_scalar;
+static char const * WINNERS_NAME = "scalar";
+
+//Sets results[i] to the state of the board with X on xs[i] and O on os[i], for each i < count.
+void bitgrid_winners(BitMask const * const xs, BitMask const * const os, size_t count, uint8_t* results) {
+    WINNERS(xs, os, count, results);
+}
+
+#if GRID_DENSE
+//The rotations and reflections of the board.
+//0 is the identity, 1 rotates by 180 degrees, 2 and 3 mirror left to right and top to bottom.
+//Square boards also have 4-5, rotating by 90 and 270 degrees, and 6-7, mirroring along the diagonals.
+enum {
+    SYMMETRIES = GRID_X_DIM == GRID_Y_DIM ? 8 : 4,
+};
+
+//POW3[n] is 3^n.
+static uint32_t const POW3[DENSE_MAX_TILES + 1] = {
+    1, 3, 9, 27, 81, 243, 729, 2187, 6561, 19683, 59049, 177147, 531441,
+    1594323, 4782969, 14348907, 43046721,
+};
+
+//3^GRID_TOTAL, one slot per board
+#define STATE_TABLE_SIZE ((size_t) POW3[GRID_TOTAL])
+
+//TERNARY[m] is the base 3 number with a 1 digit for every bit in m.
+static uint32_t TERNARY[FULL_MASK + 1];
+//SYM_TILE[s][i] is where tile i ends up under symmetry s, SYM_TILE_INVERSE undoes it.
+static uint8_t SYM_TILE[SYMMETRIES][GRID_TOTAL];
+static uint8_t SYM_TILE_INVERSE[SYMMETRIES][GRID_TOTAL];
+//SYM_MASK[s][m] moves every bit of m with SYM_TILE[s].
+static BitMask SYM_MASK[SYMMETRIES][FULL_MASK + 1];
+
+size_t symmetric_index(size_t s, size_t x, size_t y) {
+    size_t const nx = GRID_X_DIM - 1;
+    size_t const ny = GRID_Y_DIM - 1;
+    switch (s) {
+    case 0:
+        return get_index(x, y);
+    case 1:
+        return get_index(nx - x, ny - y);
+    case 2:
+        return get_index(nx - x, y);
+    case 3:
+        return get_index(x, ny - y);
+    //Square boards only from here on
+    case 4:
+        return get_index(ny - y, x);
+    case 5:
+        return get_index(y, nx - x);
+    case 6:
+        return get_index(y, x);
+    default:
+        return get_index(ny - y, nx - x);
+    }
+}
+#endif
+
+//Adds the line of GRID_K tiles from x, y going dx, dy to LINE_MASKS.
+void add_line(size_t* count, size_t x, size_t y, ptrdiff_t dx, ptrdiff_t dy) {
+    BitMask line = 0;
+    for (ptrdiff_t i = 0; i < GRID_K; i++) {
+        line |= (BitMask) 1 << get_index(x + i * dx, y + i * dy);
+    }
+    LINE_MASKS[(*count)++] = line;
+}
+
+//The splitmix64 generator, for reproducible keys.
+uint64_t next_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+}
+
+//Fills the lookup tables, safe to call more than once.
+void init_tables() {
+    static bool done = false;
+    if (done) {
+        return;
+    }
+    //Fixed seed, so keys are the same on every run.
+    uint64_t seed = 0;
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        ZOBRIST[X_PL][i] = next_random(&seed);
+        ZOBRIST[O_PL][i] = next_random(&seed);
+    }
+    ZOBRIST_O_TURN = next_random(&seed);
+    size_t lines = 0;
+    for (size_t y = 0; y < GRID_Y_DIM; y++) {
+        for (size_t x = 0; x < GRID_X_DIM; x++) {
+            bool const fits_across = x + GRID_K <= GRID_X_DIM;
+            bool const fits_down = y + GRID_K <= GRID_Y_DIM;
+            if (fits_across) {
+                add_line(&lines, x, y, 1, 0);
+            }
+            if (fits_down) {
+                add_line(&lines, x, y, 0, 1);
+            }
+            if (fits_across && fits_down) {
+                add_line(&lines, x, y, 1, 1);
+            }
+            if (x + 1 >= GRID_K && fits_down) {
+                add_line(&lines, x, y, -1, 1);
+            }
+        }
+    }
+    //Tiles on more lines first, ties in index order.
+    size_t on_lines[GRID_TOTAL] = {0};
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        for (size_t l = 0; l < GRID_LINES; l++) {
+            if ((LINE_MASKS[l] >> i) & 1) {
+                TILE_LINES[i][on_lines[i]++] = l;
+            }
+        }
+        TILE_LINE_COUNT[i] = on_lines[i];
+        size_t j = i;
+        while (j > 0 && on_lines[TILE_ORDER[j - 1]] < on_lines[i]) {
+            TILE_ORDER[j] = TILE_ORDER[j - 1];
+            j--;
+        }
+        TILE_ORDER[j] = i;
+    }
+#if GRID_DENSE
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        for (size_t m = 0; m <= FULL_MASK; m++) {
+            if (m & ((size_t) 1 << i)) {
+                TERNARY[m] += POW3[i];
+            }
+        }
+    }
+    for (size_t s = 0; s < SYMMETRIES; s++) {
+        for (size_t y = 0; y < GRID_Y_DIM; y++) {
+            for (size_t x = 0; x < GRID_X_DIM; x++) {
+                size_t const to = symmetric_index(s, x, y);
+                SYM_TILE[s][get_index(x, y)] = to;
+                SYM_TILE_INVERSE[s][to] = get_index(x, y);
+            }
+        }
+        for (size_t m = 0; m <= FULL_MASK; m++) {
+            for (size_t i = 0; i < GRID_TOTAL; i++) {
+                if (m & ((size_t) 1 << i)) {
+                    SYM_MASK[s][m] |= (BitMask) 1 << SYM_TILE[s][i];
+                }
+            }
+        }
+    }
+#endif
+    WINNERS = best_winners(&WINNERS_NAME);
+    done = true;
+}
+
+//Declared for every board size, so engines can be passed around as pointers,
+//but only defined when the board fits the table.
+typedef struct GridStateMap GridStateMap;
+
+#if GRID_DENSE
+//Memoization solution
+
+//Perfect hash table: every board has its own slot, indexed by the base 3
+//encoding of its tiles (EMPTY = 0, X = 1, O = 2, tile 0 is the lowest digit).
+//The side to move is not part of the key, since games start with X it
+//follows from the number of pieces on the board.
+//Only the canonical board of each symmetry class is stored, see canonical_grid.
+//Slots hold a WinState, UNKNOWN = 0 means not calculated yet.
+
+//Slots are packed 2 bits each into 64 bit words, with DRAW stored as 3.
+//That's about 5 KB for 3x3, so the whole table stays in L1, and about 10 MB for 4x4.
+enum {
+    SLOTS_PER_WORD = 32,
+    PACKED_DRAW = 3,
+};
+
+//Words for the whole table
+#define STATE_TABLE_WORDS ((STATE_TABLE_SIZE + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD)
+#define STATE_TABLE_BYTES (STATE_TABLE_WORDS * sizeof(uint64_t))
+//Words for a set of slots, one bit each
+#define SLOT_BIT_WORDS ((STATE_TABLE_SIZE + 63) / 64)
+
+//Slot i's state out of the word that holds it.
+WinState unpack_state(uint64_t const word, size_t i) {
+    unsigned const bits = (word >> (2 * (i % SLOTS_PER_WORD))) & 3;
+    return bits == PACKED_DRAW ? DRAW : (WinState) bits;
+}
+
+//The bits to put in slot i's word to store state.
+uint64_t pack_state(WinState const state, size_t i) {
+    uint64_t const bits = state == DRAW ? PACKED_DRAW : state;
+    return bits << (2 * (i % SLOTS_PER_WORD));
+}
+
+WinState packed_get(uint64_t const * const words, size_t i) {
+    WinState const state = unpack_state(words[i / SLOTS_PER_WORD], i);
+    STAT_ADD(probes, 1);
+    STAT_ADD(hits, state != UNKNOWN);
+    return state;
+}
+
+void packed_set(uint64_t* words, size_t i, WinState state) {
+    STAT_ADD(inserts, 1);
+    uint64_t* word = &words[i / SLOTS_PER_WORD];
+    *word = (*word & ~pack_state(DRAW, i)) | pack_state(state, i);
+}
+
+//Number of slots in a word that aren't UNKNOWN.
+size_t word_slots_used(uint64_t const word) {
+    //One bit for every slot with either of its bits set
+    return count_tiles((word | word >> 1) & 0x5555555555555555u);
+}
+
+//One bit for each slot of a word that isn't UNKNOWN, slot i in bit i.
+uint64_t word_slots_mask(uint64_t const word) {
+    //Squeezes out the odd bits, halving the gaps each step
+    uint64_t bits = (word | word >> 1) & 0x5555555555555555u;
+    bits = (bits | bits >> 1) & 0x3333333333333333u;
+    bits = (bits | bits >> 2) & 0x0F0F0F0F0F0F0F0Fu;
+    bits = (bits | bits >> 4) & 0x00FF00FF00FF00FFu;
+    bits = (bits | bits >> 8) & 0x0000FFFF0000FFFFu;
+    return (bits | bits >> 16) & 0x00000000FFFFFFFFu;
+}
+
+//Number of slots in the table that aren't UNKNOWN.
+size_t packed_count(uint64_t const * const words) {
+    size_t count = 0;
+    for (size_t i = 0; i < STATE_TABLE_WORDS; i++) {
+        count += word_slots_used(words[i]);
+    }
+    return count;
+}
+
+//The table comes from the map's arena, so destroy_map releases everything at once.
+//The solver's work queue lives next to it and is kept between solves.
+//A map loaded from a database uses the mapped file instead, and is read only, see load_database.
+//So is the embedded map, which lives in static memory and is never destroyed.
+struct GridStateMap {
+    uint64_t* data; //STATE_TABLE_SIZE packed slots, see packed_get
+    uint8_t* best; //Annotation for every solved slot, or null. See annotation_index.
+    uint32_t* ranks; //Solved slots before each RANK_BLOCK of slots, when best isn't null
+    size_t annotated; //Entries in best
+    size_t scratch; //Bytes the last solve used outside the arena and the frontier, and freed again
+    size_t threads; //For the solvers that can use more than one, 0 for one per core
+    Arena arena;
+    PositionQueue frontier;
+    void* mapping; //The mapped database file, or null
+    size_t mapping_size;
+    bool is_static; //destroy_map leaves this map alone
+};
+
+//Returns null on allocation error.
+GridStateMap* init_map(GridStateMap* mpt) {
+    if (mpt) {
+        init_tables();
+        init_arena(&mpt->arena);
+        init_queue(&mpt->frontier);
+        mpt->best = nullptr;
+        mpt->ranks = nullptr;
+        mpt->annotated = 0;
+        mpt->scratch = 0;
+        mpt->threads = 0;
+        mpt->mapping = nullptr;
+        mpt->mapping_size = 0;
+        mpt->is_static = false;
+        if (!(mpt->data = arena_alloc(&mpt->arena, STATE_TABLE_BYTES))) {
+            return nullptr;
+        }
+        memset(mpt->data, UNKNOWN, STATE_TABLE_BYTES);
+    }
+    return mpt;
+}
+
+
+GridStateMap* new_map() {
+    GridStateMap* mpt = malloc(sizeof(GridStateMap));
+    if (mpt && !init_map(mpt)) {
+        free(mpt);
+        return nullptr;
+    }
+    return mpt;
+}
+
+//Forgets every solved position, keeping the arena's memory for the next solve.
+GridStateMap* reset_map(GridStateMap* mpt) {
+    arena_reset(&mpt->arena);
+    clear_queue(&mpt->frontier);
+    mpt->best = nullptr;
+    mpt->ranks = nullptr;
+    mpt->annotated = 0;
+    //The kept block is at least as big as the table, so this can't fail.
+    mpt->data = arena_alloc(&mpt->arena, STATE_TABLE_BYTES);
+    memset(mpt->data, UNKNOWN, STATE_TABLE_BYTES);
+    return mpt;
+}
+
+//Only use from new_map!
+void destroy_map(GridStateMap* mpt) {
+    if (mpt && !mpt->is_static) {
+#if HAVE_MMAP
+        if (mpt->mapping) {
+            munmap(mpt->mapping, mpt->mapping_size);
+        }
+#endif
+        destroy_arena(&mpt->arena);
+        destroy_queue(&mpt->frontier);
+        free(mpt);
+    }
+}
+
+//Does not consume
+//Returns the base 3 index of the board, 0 <= h < STATE_TABLE_SIZE.
+size_t hash_grid(BitGrid const g) {
+    return TERNARY[g.x] + 2 * (size_t) TERNARY[g.o];
+}
+
+//Returns the representative of the symmetry class of g: the transform with the lowest index.
+//If sym isn't null, it is set to the symmetry that maps g onto the representative.
+BitGrid canonical_grid(BitGrid const g, size_t* sym) {
+    BitGrid best = g;
+    size_t best_sym = 0;
+    size_t best_index = hash_grid(g);
+    for (size_t s = 1; s < SYMMETRIES; s++) {
+        BitGrid const t = {SYM_MASK[s][g.x], SYM_MASK[s][g.o], g.o_turn};
+        size_t const index = hash_grid(t);
+        if (index < best_index) {
+            best = t;
+            best_sym = s;
+            best_index = index;
+        }
+    }
+    if (sym) {
+        *sym = best_sym;
+    }
+    return best;
+}
+
+//Returns the state in the slot for grid, which is shared by its whole symmetry class.
+//There is a slot for every board so this never fails,
+//a slot holding UNKNOWN is a miss, and with insert it is set to state.
+WinState map_lookup_with_insert(GridStateMap* map, BitGrid const grid, bool insert, WinState state) {
+    size_t const index = hash_grid(canonical_grid(grid, nullptr));
+    WinState const found = packed_get(map->data, index);
+    if (insert && found == UNKNOWN) {
+        packed_set(map->data, index, state);
+        return state;
+    }
+    return found;
+}
+
+
+//Writes the possible next positions into moves, and returns how many there are.
+//Moves are canonical, and moves that are symmetric to each other are only listed once.
+size_t find_possible_moves(BitGrid const current_grid, BitGrid moves[GRID_TOTAL]) {
+    size_t count = 0;
+    //Bit scan over the empty tiles, a full board has no next states.
+    for (BitMask empty = bitgrid_empty(current_grid); empty; empty &= empty - 1) {
+        BitGrid const child = canonical_grid(bitgrid_move(current_grid, lowest_tile(empty)), nullptr);
+        size_t i = 0;
+        while (i < count && !bitgrid_equals(moves[i], child)) {
+            i++;
+        }
+        if (i == count) {
+            moves[count++] = child;
+        }
+    }
+    return count;
+}
+
+
+
+//Populates the map with the given starting grid
+
+//Do breadth first search: add the possible moves to the end. 
+//The queue is the map's frontier, its peak size is left in map->frontier.peak.
+//Returns UNKNOWN on allocation error.
+WinState calculate_position(GridStateMap* map, Grid const * const start_grid) {
+    BitGrid const start = canonical_grid(bitgrid_from_grid(start_grid), nullptr);
+    PositionQueue* to_calculate = &map->frontier;
+    STAT_CLOCK(begin);
+
+    clear_queue(to_calculate);
+    if (!queue_push(to_calculate, start)) {
+        return UNKNOWN;
+    }
+
+    BitGrid current_grid;
+    BitGrid possible_moves[GRID_TOTAL];
+    Player current_player;
+    while(queue_pop(to_calculate, &current_grid)) {
+        current_player = bitgrid_player(current_grid);
+        //Check if current is an ended game:
+        //Or if the position has been calculated already
+
+        //Queued positions are canonical, so this is their slot.
+        size_t const map_node = hash_grid(current_grid);
+        WinState node_state = packed_get(map->data, map_node);
+        //If we haven't seen it before!
+        if (node_state == UNKNOWN) {
+            Player pot_winner = bitgrid_has_won(current_grid);
+            if (pot_winner != EMPTY) {
+                node_state = (WinState) pot_winner; //This is just an integer cast.
+            } else if (bitgrid_is_full(current_grid)) {
+                //Draw condition
+                node_state = DRAW;
+            }
+            packed_set(map->data, map_node, node_state);
+        } 
+        //This happens if we have calculated the node before, or
+        //if we just assigned it a value.
+        if (node_state != UNKNOWN) {
+            //Already popped, we're done processing it.
+            continue;
+        }
+
+        //Otherwise, we need to process all the possible moves from the current position. 
+        size_t const move_count = find_possible_moves(current_grid, possible_moves);
+        STAT_ADD(expanded, 1);
+
+        //If we see a winning state (so a losing state for the next player), it's a win.
+
+        //If all are losses, it's a loss
+
+        //else it's a draw. 
+        bool is_win = false;
+        bool add_to_list = false;
+        bool all_losses = true;
+
+        WinState iter_node = UNKNOWN;
+
+        for (size_t i = 0; i < move_count; i++) {
+            //The moves are canonical too.
+            iter_node = packed_get(map->data, hash_grid(possible_moves[i]));
+
+            if (iter_node == (WinState) current_player) {
+                //If we see a winning state (so a losing state for the next player), it's a win.
+                packed_set(map->data, map_node, (WinState) current_player);
+                is_win = true;
+                all_losses = false;
+                add_to_list = false;
+                break;
+            } else if (add_to_list) {
+                continue;
+            } else if (iter_node == UNKNOWN) {
+                //We need more processing
+                all_losses = false;
+                add_to_list = true;
+                continue; //We want to loop to the end of the list anyway here
+            } else if (iter_node == DRAW) {
+                //At least one draw, so it isn't a loss
+                all_losses = false;
+            }
+        }
+        //If we find a win, there is no need to calculate the other positions!
+        if (is_win) {
+            continue;
+        } else if (add_to_list) {
+            //Queue the moves, then this position again after them, as there are unprocessed things.
+            STAT_ADD(requeued, 1);
+            for (size_t i = 0; i < move_count; i++) {
+                if (!queue_push(to_calculate, possible_moves[i])) {
+                    return UNKNOWN;
+                }
+            }
+            if (!queue_push(to_calculate, current_grid)) {
+                return UNKNOWN;
+            }
+        } else if (all_losses) {
+            //Loss condition
+            packed_set(map->data, map_node, (WinState) next_player(current_player));
+        } else {
+            //Draw condition. Not any of the previous: either a win or all losses.
+            packed_set(map->data, map_node, DRAW);
+        }
+    }
+    STAT_PHASE(PHASE_SEARCH, begin);
+    return map_lookup_with_insert(map, start, false, UNKNOWN);
+}
+
+
+//Annotations: the best move from a position, and how many moves are left in the game when both sides play well.
+//Wins are as quick as possible and losses as slow as possible, and a draw always lasts until the board is full.
+//The move is in the low 4 bits, on the canonical board, and the moves left minus 1 in the high 4 bits.
+//Only the empty 4x4 board has 16 moves left, and its best move is never tile 15, so ANNOTATION_NONE is free.
+enum {
+    ANNOTATION_NONE = 0xFF, //Game over, or not worked out
+    ANNOTATION_MOVE = 0x0F,
+    ANNOTATION_PLIES_SHIFT = 4,
+};
+
+uint8_t annotation(size_t move, size_t plies) {
+    return (uint8_t) ((plies - 1) << ANNOTATION_PLIES_SHIFT | move);
+}
+
+//Moves left in the game, 0 if the slot's annotation is ANNOTATION_NONE.
+size_t annotation_plies(uint8_t const a) {
+    return a == ANNOTATION_NONE ? 0 : (size_t) (a >> ANNOTATION_PLIES_SHIFT) + 1;
+}
+
+//Only solved slots have annotations, a byte each in slot order, so a few percent of the table on 4x4.
+//A slot's annotation is at its rank, the number of solved slots before it: the count kept for its block
+//of RANK_BLOCK slots, plus the ones before it in the block.
+enum {
+    RANK_BLOCK = 256, //8 table words
+};
+
+#define RANK_BLOCKS ((STATE_TABLE_SIZE + RANK_BLOCK - 1) / RANK_BLOCK)
+
+//Sets the map's ranks from its table. Returns the number of solved slots.
+size_t rank_map(GridStateMap* map) {
+    size_t count = 0;
+    for (size_t w = 0; w < STATE_TABLE_WORDS; w++) {
+        if (w % (RANK_BLOCK / SLOTS_PER_WORD) == 0) {
+            map->ranks[w / (RANK_BLOCK / SLOTS_PER_WORD)] = count;
+        }
+        count += word_slots_used(map->data[w]);
+    }
+    return count;
+}
+
+//Where slot i, which is solved, keeps its annotation in map->best.
+size_t annotation_index(GridStateMap const * const map, size_t i) {
+    size_t const word = i / SLOTS_PER_WORD;
+    size_t rank = map->ranks[i / RANK_BLOCK];
+    for (size_t w = word - word % (RANK_BLOCK / SLOTS_PER_WORD); w < word; w++) {
+        rank += word_slots_used(map->data[w]);
+    }
+    return rank + word_slots_used(map->data[word] & (((uint64_t) 1 << (2 * (i % SLOTS_PER_WORD))) - 1));
+}
+
+//Slot i's annotation, ANNOTATION_NONE if it has none.
+uint8_t map_annotation(GridStateMap const * const map, size_t i) {
+    bool const solved = unpack_state(map->data[i / SLOTS_PER_WORD], i) != UNKNOWN;
+    return map->best && solved ? map->best[annotation_index(map, i)] : ANNOTATION_NONE;
+}
+
+//While a solve runs, the slots it will have solved are a bitset, and ranks are counted in that instead.
+size_t slot_bit_rank(uint64_t const * const bits, uint32_t const * const ranks, size_t i) {
+    size_t const word = i / 64;
+    size_t rank = ranks[i / RANK_BLOCK];
+    for (size_t w = word - word % (RANK_BLOCK / 64); w < word; w++) {
+        rank += count_tiles(bits[w]);
+    }
+    return rank + count_tiles(bits[word] & (((uint64_t) 1 << (i % 64)) - 1));
+}
+
+//Gives the map a fresh annotation table, for a solve about to solve every slot set in seen.
+//The slots already solved are added to seen, so it ends up the same as the solved slots,
+//and the ranks counted now in seen stay right for the table after the solve.
+//Returns false on allocation error.
+bool init_annotations(GridStateMap* map, uint64_t* seen) {
+    for (size_t w = 0; w < SLOT_BIT_WORDS; w++) {
+        seen[w] |= word_slots_mask(map->data[2 * w]);
+        if (2 * w + 1 < STATE_TABLE_WORDS) {
+            seen[w] |= word_slots_mask(map->data[2 * w + 1]) << SLOTS_PER_WORD;
+        }
+    }
+    if (!(map->ranks = arena_alloc(&map->arena, RANK_BLOCKS * sizeof(uint32_t)))) {
+        return false;
+    }
+    size_t count = 0;
+    for (size_t w = 0; w < SLOT_BIT_WORDS; w++) {
+        if (w % (RANK_BLOCK / 64) == 0) {
+            map->ranks[w / (RANK_BLOCK / 64)] = count;
+        }
+        count += count_tiles(seen[w]);
+    }
+    map->annotated = count;
+    if (!(map->best = arena_alloc(&map->arena, count))) {
+        return false;
+    }
+    memset(map->best, ANNOTATION_NONE, count);
+    return true;
+}
+
+//Retrograde solver: same result as calculate_position, but every position is finalized exactly once.
+
+//REMAINING values: the count of unresolved canonical children, or 0 before the first of them is solved,
+//with REMAINING_DRAW set once one of them is a draw.
+enum {
+    REMAINING_DRAW = 0x80,
+    REMAINING_COUNT = 0x7F,
+};
+
+//Populates the map with the given starting grid.
+
+//First enumerates every position reachable from start_grid, and seeds the won and full boards.
+//Then walks backwards from the solved positions: a parent is a win as soon as one child is,
+//otherwise it is solved when its last child is, as a draw if any child was a draw.
+//Positions already in the map count as solved.
+//The enumeration runs on the map's frontier, so its peak is left in map->frontier.peak.
+
+//Along the way it annotates every position in map->best. Positions come off the solved queue
+//in order of moves left, so the first winning child found is the quickest win,
+//and the last child of a loss is the slowest one.
+//The children are only counted once the first of them is solved, so the counts can be packed
+//by rank like the annotations, and the many positions won by their first solved child are never counted.
+//Returns UNKNOWN on allocation error.
+WinState calculate_position_retrograde(GridStateMap* map, Grid const * const start_grid) {
+    BitGrid const start = canonical_grid(bitgrid_from_grid(start_grid), nullptr);
+
+    STAT_CLOCK(begin);
+    uint64_t* seen = calloc(SLOT_BIT_WORDS, sizeof(uint64_t)); //Reachable from the start board
+    STAT_ALLOC(SLOT_BIT_WORDS * sizeof(uint64_t));
+    uint8_t* remaining = nullptr; //By rank, see slot_bit_rank
+    PositionQueue* positions = &map->frontier; //Reachable positions still to enumerate
+    PositionQueue solved; //Positions whose state is final
+    init_queue(&solved);
+
+    clear_queue(positions);
+    bool ok = seen && queue_push(positions, start);
+    if (ok) {
+        seen[hash_grid(start) / 64] |= (uint64_t) 1 << (hash_grid(start) % 64);
+    }
+
+    BitGrid current;
+    BitGrid children[GRID_TOTAL];
+
+    //Forward pass: enumerate and seed.
+    while (ok && queue_pop(positions, &current)) {
+        size_t const index = hash_grid(current);
+        Player const pot_winner = bitgrid_has_won(current);
+
+        if (packed_get(map->data, index) == UNKNOWN) {
+            if (pot_winner != EMPTY) {
+                packed_set(map->data, index, (WinState) pot_winner);
+            } else if (bitgrid_is_full(current)) {
+                packed_set(map->data, index, DRAW);
+            }
+        }
+        if (packed_get(map->data, index) != UNKNOWN) {
+            ok = queue_push(&solved, current);
+            continue;
+        }
+
+        size_t const count = find_possible_moves(current, children);
+        STAT_ADD(expanded, 1);
+        for (size_t i = 0; ok && i < count; i++) {
+            size_t const child_index = hash_grid(children[i]);
+            uint64_t const bit = (uint64_t) 1 << (child_index % 64);
+            if (!(seen[child_index / 64] & bit)) {
+                seen[child_index / 64] |= bit;
+                ok = queue_push(positions, children[i]);
+            }
+        }
+    }
+
+    STAT_PHASE(PHASE_FORWARD, begin);
+    STAT_CLOCK(backward_begin);
+    ok = ok && init_annotations(map, seen) && (remaining = calloc(map->annotated, 1));
+    STAT_ALLOC(map->annotated);
+
+    //Backward pass: each solved position resolves or counts down its parents.
+    while (ok && queue_pop(&solved, &current)) {
+        WinState const state = packed_get(map->data, hash_grid(current));
+        //For the parents
+        size_t const plies = annotation_plies(map->best[slot_bit_rank(seen, map->ranks, hash_grid(current))]) + 1;
+        //The parents have the other side to move, and one less of its pieces.
+        bool const o_moved = !current.o_turn;
+        Player const mover = o_moved ? O_PL : X_PL;
+
+        BitGrid parents[GRID_TOTAL];
+        size_t parent_count = 0;
+        for (BitMask pieces = o_moved ? current.o : current.x; pieces; pieces &= pieces - 1) {
+            BitGrid parent = current;
+            size_t const tile = lowest_tile(pieces);
+            if (o_moved) {
+                parent.o &= ~((BitMask) 1 << tile);
+            } else {
+                parent.x &= ~((BitMask) 1 << tile);
+            }
+            parent.o_turn = o_moved;
+            size_t sym = 0;
+            parent = canonical_grid(parent, &sym);
+            size_t const move = SYM_TILE[sym][tile]; //From the canonical parent to current
+
+            //Symmetric parents are the same edge, count it once.
+            size_t i = 0;
+            while (i < parent_count && !bitgrid_equals(parents[i], parent)) {
+                i++;
+            }
+            if (i < parent_count) {
+                continue;
+            }
+            parents[parent_count++] = parent;
+
+            size_t const parent_index = hash_grid(parent);
+            if (!(seen[parent_index / 64] & ((uint64_t) 1 << (parent_index % 64)))
+                    || packed_get(map->data, parent_index) != UNKNOWN) {
+                continue;
+            }
+            size_t const rank = slot_bit_rank(seen, map->ranks, parent_index);
+            if (state == (WinState) mover) {
+                packed_set(map->data, parent_index, (WinState) mover);
+                map->best[rank] = annotation(move, plies);
+            } else {
+                if ((remaining[rank] & REMAINING_COUNT) == 0) {
+                    remaining[rank] |= find_possible_moves(parent, children);
+                }
+                if (state == DRAW) {
+                    remaining[rank] |= REMAINING_DRAW;
+                    //Every draw runs until the board is full, so any drawing move will do.
+                    map->best[rank] = annotation(move, count_tiles(bitgrid_empty(parent)));
+                }
+                remaining[rank]--;
+                if ((remaining[rank] & REMAINING_COUNT) != 0) {
+                    continue;
+                }
+                //All children are solved, none of them a win.
+                if (remaining[rank] & REMAINING_DRAW) {
+                    packed_set(map->data, parent_index, DRAW);
+                } else {
+                    packed_set(map->data, parent_index, (WinState) next_player(mover));
+                    map->best[rank] = annotation(move, plies);
+                }
+            }
+            ok = queue_push(&solved, parent);
+        }
+    }
+
+    STAT_PHASE(PHASE_BACKWARD, backward_begin);
+    map->scratch = SLOT_BIT_WORDS * sizeof(uint64_t) + map->annotated + solved.capacity * sizeof(BitGrid);
+    free(seen);
+    free(remaining);
+    destroy_queue(&solved);
+    return ok ? packed_get(map->data, hash_grid(start)) : UNKNOWN;
+}
+
+
+//Layered solver: the retrograde idea, run in parallel.
+
+//Every move adds a piece, so the positions fall into layers by piece count, and the children
+//of a layer are all in the next one. First the layers are found going forwards from the start board,
+//then solved going backwards from the full boards, each layer in one go once the next one is done.
+//Within a layer the positions don't depend on each other, so the threads take chunks of it
+//off a shared counter, and whichever thread is free takes the next chunk.
+
+enum {
+    LAYER_CHUNK = 256, //Positions a thread claims at a time
+};
+
+//All the threads meet here between steps, and none go on until they all have.
+typedef struct Barrier Barrier;
+struct Barrier {
+#if HAVE_THREADS
+    mtx_t lock;
+    cnd_t opened;
+#endif
+    size_t count; //Threads taking part
+    size_t waiting;
+    size_t generation; //Bumped every time the barrier opens
+};
+
+//Returns false if the lock couldn't be made.
+bool init_barrier(Barrier* b, size_t count) {
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+#if HAVE_THREADS
+    if (mtx_init(&b->lock, mtx_plain) != thrd_success) {
+        return false;
+    }
+    if (cnd_init(&b->opened) != thrd_success) {
+        mtx_destroy(&b->lock);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void destroy_barrier(Barrier* b) {
+#if HAVE_THREADS
+    cnd_destroy(&b->opened);
+    mtx_destroy(&b->lock);
+#endif
+}
+
+#if HAVE_THREADS
+//Call with the lock held.
+void open_barrier(Barrier* b) {
+    b->waiting = 0;
+    b->generation++;
+    cnd_broadcast(&b->opened);
+}
+#endif
+
+void barrier_wait(Barrier* b) {
+#if HAVE_THREADS
+    mtx_lock(&b->lock);
+    size_t const generation = b->generation;
+    if (++b->waiting == b->count) {
+        open_barrier(b);
+    } else {
+        while (generation == b->generation) {
+            cnd_wait(&b->opened, &b->lock);
+        }
+    }
+    mtx_unlock(&b->lock);
+#endif
+}
+
+//Takes a thread out for good, for when it couldn't be started.
+void barrier_drop(Barrier* b) {
+#if HAVE_THREADS
+    mtx_lock(&b->lock);
+    b->count--;
+    if (b->waiting > 0 && b->waiting == b->count) {
+        open_barrier(b);
+    }
+    mtx_unlock(&b->lock);
+#endif
+}
+
+//How a layered solve went, layer by layer.
+typedef struct LayerStats LayerStats;
+struct LayerStats {
+    size_t threads;
+    size_t positions[GRID_TOTAL + 1]; //Canonical positions with that many pieces
+    double expand_time[GRID_TOTAL + 1]; //Seconds finding the next layer from this one
+    double solve_time[GRID_TOTAL + 1]; //Seconds solving this layer
+};
+
+typedef struct LayeredSolve LayeredSolve;
+struct LayeredSolve {
+    GridStateMap* map;
+    //The map's table. Threads share its words, so slots are only written with atomic_fetch_or,
+    //which is enough as every slot is written once, from UNKNOWN.
+    _Atomic uint64_t* states;
+    _Atomic uint64_t* seen; //One bit per slot, set when the position is put in a layer
+    BitGrid* layers[GRID_TOTAL + 1];
+    size_t first; //The start board's layer
+    LayerStats* stats;
+    PositionQueue* found; //The next layer, as found by each thread
+    atomic_size_t next; //The first unclaimed position of the current layer
+    atomic_bool failed; //Allocation error
+    Barrier barrier;
+};
+
+typedef struct LayeredWorker LayeredWorker;
+struct LayeredWorker {
+    LayeredSolve* solve;
+    size_t id; //The thread that does the joining up between steps is 0
+};
+
+WinState shared_get(_Atomic uint64_t* words, size_t i) {
+    WinState const state = unpack_state(atomic_load_explicit(&words[i / SLOTS_PER_WORD], memory_order_relaxed), i);
+    STAT_ADD(probes, 1);
+    STAT_ADD(hits, state != UNKNOWN);
+    return state;
+}
+
+//Only for slots that are still UNKNOWN.
+void shared_set(_Atomic uint64_t* words, size_t i, WinState state) {
+    STAT_ADD(inserts, 1);
+    atomic_fetch_or_explicit(&words[i / SLOTS_PER_WORD], pack_state(state, i), memory_order_relaxed);
+}
+
+//Claims the next chunk of a layer of the given size as [begin, end).
+//Returns false once the whole layer is taken.
+bool claim_chunk(LayeredSolve* ls, size_t size, size_t* begin, size_t* end) {
+    *begin = atomic_fetch_add_explicit(&ls->next, LAYER_CHUNK, memory_order_relaxed);
+    *end = *begin + LAYER_CHUNK < size ? *begin + LAYER_CHUNK : size;
+    return *begin < size;
+}
+
+//Puts the children of pos that aren't in the next layer yet into found.
+//Game overs and positions the map already knows aren't expanded.
+//Returns false on allocation error.
+bool expand_layered_position(LayeredSolve* ls, BitGrid const pos, PositionQueue* found) {
+    if (bitgrid_has_won(pos) != EMPTY || shared_get(ls->states, hash_grid(pos)) != UNKNOWN) {
+        return true;
+    }
+    STAT_ADD(expanded, 1);
+    for (BitMask empty = bitgrid_empty(pos); empty; empty &= empty - 1) {
+        BitGrid const child = canonical_grid(bitgrid_move(pos, lowest_tile(empty)), nullptr);
+        size_t const index = hash_grid(child);
+        uint64_t const bit = (uint64_t) 1 << (index % 64);
+        if (!(atomic_fetch_or_explicit(&ls->seen[index / 64], bit, memory_order_relaxed) & bit)
+                && !queue_push(found, child)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Solves pos from its children, which are all solved, and annotates it like the retrograde solver does:
+//the quickest win, else any draw, else the slowest loss.
+void solve_layered_position(LayeredSolve* ls, BitGrid const pos) {
+    size_t const index = hash_grid(pos);
+    uint8_t* best = ls->map->best;
+    uint32_t const * const ranks = ls->map->ranks;
+    //The layers are all found, so nothing writes seen any more.
+    uint64_t const * const seen = (uint64_t const *) ls->seen;
+    if (shared_get(ls->states, index) != UNKNOWN) {
+        return;
+    }
+    Player const pot_winner = bitgrid_has_won(pos);
+    if (pot_winner != EMPTY) {
+        shared_set(ls->states, index, (WinState) pot_winner);
+        return;
+    } else if (bitgrid_is_full(pos)) {
+        shared_set(ls->states, index, DRAW);
+        return;
+    }
+
+    Player const mover = bitgrid_player(pos);
+    size_t win = GRID_TOTAL;
+    size_t win_plies = GRID_TOTAL + 1;
+    size_t draw = GRID_TOTAL;
+    size_t loss = GRID_TOTAL;
+    size_t loss_plies = 0;
+    for (BitMask empty = bitgrid_empty(pos); empty; empty &= empty - 1) {
+        size_t const tile = lowest_tile(empty);
+        size_t const child = hash_grid(canonical_grid(bitgrid_move(pos, tile), nullptr));
+        WinState const state = shared_get(ls->states, child);
+        size_t const plies = annotation_plies(best[slot_bit_rank(seen, ranks, child)]) + 1;
+        if (state == (WinState) mover) {
+            if (plies < win_plies) {
+                win = tile;
+                win_plies = plies;
+            }
+        } else if (state == DRAW) {
+            //The first one, so the empty board's move is never tile 15, see ANNOTATION_NONE.
+            draw = draw < GRID_TOTAL ? draw : tile;
+        } else if (plies > loss_plies) {
+            loss = tile;
+            loss_plies = plies;
+        }
+    }
+    //Each annotation belongs to one position, so they don't need to be atomic.
+    size_t const rank = slot_bit_rank(seen, ranks, index);
+    if (win < GRID_TOTAL) {
+        shared_set(ls->states, index, (WinState) mover);
+        best[rank] = annotation(win, win_plies);
+    } else if (draw < GRID_TOTAL) {
+        shared_set(ls->states, index, DRAW);
+        best[rank] = annotation(draw, count_tiles(bitgrid_empty(pos)));
+    } else {
+        shared_set(ls->states, index, (WinState) next_player(mover));
+        best[rank] = annotation(loss, loss_plies);
+    }
+}
+
+//Joins what the threads found into the layer with the given piece count.
+//Returns false on allocation error.
+bool gather_layer(LayeredSolve* ls, size_t pieces, size_t threads) {
+    size_t size = 0;
+    for (size_t t = 0; t < threads; t++) {
+        size += ls->found[t].size;
+    }
+    if (size == 0) {
+        return true;
+    } else if (!(ls->layers[pieces] = malloc(size * sizeof(BitGrid)))) {
+        return false;
+    }
+    STAT_ALLOC(size * sizeof(BitGrid));
+    //Nothing is ever popped from found, so each one is a plain array from its start.
+    size_t used = 0;
+    for (size_t t = 0; t < threads; t++) {
+        if (ls->found[t].size) {
+            memcpy(ls->layers[pieces] + used, ls->found[t].data, ls->found[t].size * sizeof(BitGrid));
+            used += ls->found[t].size;
+        }
+    }
+    ls->stats->positions[pieces] = size;
+    return true;
+}
+
+//Every thread runs this, in step with the others.
+void run_layered(LayeredSolve* ls, size_t id) {
+    LayerStats* stats = ls->stats;
+    size_t const threads = stats->threads;
+    double begin = seconds_now();
+    STAT_CLOCK(phase_begin);
+    size_t start = 0;
+    size_t end = 0;
+
+    //Forward: find each layer from the one before.
+    for (size_t pieces = ls->first; pieces < GRID_TOTAL && stats->positions[pieces]; pieces++) {
+        PositionQueue* found = &ls->found[id];
+        clear_queue(found);
+        while (claim_chunk(ls, stats->positions[pieces], &start, &end)) {
+            for (size_t i = start; i < end; i++) {
+                if (!expand_layered_position(ls, ls->layers[pieces][i], found)) {
+                    atomic_store(&ls->failed, true);
+                }
+            }
+        }
+        barrier_wait(&ls->barrier);
+        if (id == 0) {
+            if (atomic_load(&ls->failed) || !gather_layer(ls, pieces + 1, threads)) {
+                atomic_store(&ls->failed, true);
+                stats->positions[pieces + 1] = 0;
+            }
+            atomic_store(&ls->next, 0);
+            stats->expand_time[pieces] = seconds_now() - begin;
+            begin = seconds_now();
+        }
+        barrier_wait(&ls->barrier);
+    }
+    if (id == 0) {
+        STAT_PHASE(PHASE_FORWARD, phase_begin);
+        if (!atomic_load(&ls->failed) && !init_annotations(ls->map, (uint64_t*) ls->seen)) {
+            atomic_store(&ls->failed, true);
+        }
+    }
+    barrier_wait(&ls->barrier);
+    if (atomic_load(&ls->failed)) {
+        return;
+    }
+    STAT_CLOCK(backward_begin);
+
+    //Backward: solve each layer from the one after.
+    for (size_t pieces = GRID_TOTAL + 1; pieces-- > ls->first;) {
+        while (claim_chunk(ls, stats->positions[pieces], &start, &end)) {
+            for (size_t i = start; i < end; i++) {
+                solve_layered_position(ls, ls->layers[pieces][i]);
+            }
+        }
+        barrier_wait(&ls->barrier);
+        if (id == 0) {
+            atomic_store(&ls->next, 0);
+            stats->solve_time[pieces] = seconds_now() - begin;
+            begin = seconds_now();
+        }
+        barrier_wait(&ls->barrier);
+    }
+    if (id == 0) {
+        STAT_PHASE(PHASE_BACKWARD, backward_begin);
+    }
+}
+
+#if HAVE_THREADS
+int layered_thread(void* arg) {
+    LayeredWorker const * const worker = arg;
+    run_layered(worker->solve, worker->id);
+    return 0;
+}
+#endif
+
+//Populates the map with the given starting grid, and annotates it, on the given number of threads
+//(0 for one per core). If stats isn't null, it is filled in with the layer sizes and timings.
+//Returns UNKNOWN on allocation error.
+WinState calculate_position_layered_on(GridStateMap* map, Grid const * const start_grid, size_t threads, LayerStats* stats) {
+    BitGrid const start = canonical_grid(bitgrid_from_grid(start_grid), nullptr);
+#if HAVE_THREADS
+    threads = threads ? threads : core_count();
+#else
+    threads = 1;
+#endif
+    LayerStats own_stats;
+    stats = stats ? stats : &own_stats;
+    memset(stats, 0, sizeof(LayerStats));
+    stats->threads = threads;
+
+    LayeredSolve ls;
+    ls.map = map;
+    ls.states = (_Atomic uint64_t*) map->data;
+    ls.seen = calloc(SLOT_BIT_WORDS, sizeof(uint64_t));
+    STAT_ALLOC(SLOT_BIT_WORDS * sizeof(uint64_t));
+    memset(ls.layers, 0, sizeof(ls.layers));
+    ls.first = count_tiles(start.x | start.o);
+    ls.stats = stats;
+    ls.found = malloc(threads * sizeof(PositionQueue));
+    atomic_init(&ls.next, 0);
+    atomic_init(&ls.failed, false);
+
+    bool const ok = ls.seen && ls.found && (ls.layers[ls.first] = malloc(sizeof(BitGrid)))
+        && init_barrier(&ls.barrier, threads);
+    if (ok) {
+        for (size_t t = 0; t < threads; t++) {
+            init_queue(&ls.found[t]);
+        }
+        ls.layers[ls.first][0] = start;
+        stats->positions[ls.first] = 1;
+        size_t const index = hash_grid(start);
+        ls.seen[index / 64] = (uint64_t) 1 << (index % 64);
+
+#if HAVE_THREADS
+        //Thread 0 is this one.
+        LayeredWorker* workers = malloc(threads * sizeof(LayeredWorker));
+        thrd_t* handles = malloc(threads * sizeof(thrd_t));
+        bool* started = calloc(threads, sizeof(bool));
+        for (size_t t = 1; t < threads; t++) {
+            if (workers && handles && started) {
+                workers[t] = (LayeredWorker) {&ls, t};
+                started[t] = thrd_create(&handles[t], layered_thread, &workers[t]) == thrd_success;
+            }
+            if (!started || !started[t]) {
+                //It's slower, but the solve still works with fewer threads.
+                barrier_drop(&ls.barrier);
+            }
+        }
+        run_layered(&ls, 0);
+        for (size_t t = 1; started && t < threads; t++) {
+            if (started[t]) {
+                thrd_join(handles[t], nullptr);
+            }
+        }
+        free(workers);
+        free(handles);
+        free(started);
+#else
+        run_layered(&ls, 0);
+#endif
+        destroy_barrier(&ls.barrier);
+        for (size_t t = 0; t < threads; t++) {
+            destroy_queue(&ls.found[t]);
+        }
+    }
+
+    map->scratch = SLOT_BIT_WORDS * sizeof(uint64_t);
+    for (size_t i = 0; i <= GRID_TOTAL; i++) {
+        map->scratch += stats->positions[i] * sizeof(BitGrid);
+        free(ls.layers[i]);
+    }
+    free(ls.found);
+    free(ls.seen);
+    return ok && !atomic_load(&ls.failed) ? packed_get(map->data, hash_grid(start)) : UNKNOWN;
+}
+
+//The layered solver on map->threads threads, as a Solver.
+WinState calculate_position_layered(GridStateMap* map, Grid const * const start_grid) {
+    return calculate_position_layered_on(map, start_grid, map->threads, nullptr);
+}
+
+
+/*
+Returns an integer 0 <= t < GRID_TOTAL for the location of the next best move.
+Assumes the win states have been calculated already. 
+*/
+
+size_t best_move_from_map(GridStateMap * map, Grid const * const grid) {
+    //Search on the canonical board, and map the move back at the end.
+    size_t sym = 0;
+    BitGrid const current = canonical_grid(bitgrid_from_grid(grid), &sym);
+
+    WinState const map_node = map_lookup_with_insert(map, current, false, UNKNOWN);
+
+    if (map_node == UNKNOWN) {
+        return GRID_TOTAL; //Error condition: we must have generated the map already.
+    }
+    uint8_t const best = map_annotation(map, hash_grid(current));
+    if (best != ANNOTATION_NONE) {
+        return SYM_TILE_INVERSE[sym][best & ANNOTATION_MOVE];
+    }
+
+    Player player = grid->player; //The player we're finding the best move for.
+    WinState target_state = map_node; //This is the state we're looking for.  
+
+
+    //If we have a losing board
+    if (target_state == (WinState) next_player(player)) {
+        //Take the first free tile on the most lines, like the center and then the corners on 3x3.
+        for (size_t i = 0; i < GRID_TOTAL; i++) {
+            if (grid->data[TILE_ORDER[i]] == EMPTY) {
+                return TILE_ORDER[i];
+            }
+        }
+        return GRID_TOTAL; //This is returned if the board is full. 
+    } 
+
+    //Otherwise: We loop through the possible moves for lower overhead
+    //State should be either our player or is DRAW. 
+
+    WinState iter_node = UNKNOWN;
+
+    //If the board is a draw or win:
+
+
+    for (BitMask empty = bitgrid_empty(current); empty; empty &= empty - 1) {
+        size_t const i = lowest_tile(empty);
+
+        iter_node = map_lookup_with_insert(map, bitgrid_move(current, i), false, UNKNOWN);
+
+        if (iter_node == UNKNOWN) {
+            return GRID_TOTAL; //Again, this is an error condition. Map wasn't sufficiently generated
+        }
+
+        //Now we calculate the logic
+
+        //If we find a condition matching the target state, return this as the move
+        if (iter_node == target_state) {
+            return SYM_TILE_INVERSE[sym][i];
+        }
+    }
+
+    return GRID_TOTAL; //This is an error condition: couldn't find win or draw??
+}
+
+//Returns how many moves are left in the game with best play from grid, 0 if it is over,
+//or GRID_TOTAL + 1 if the map doesn't know.
+size_t plies_from_map(GridStateMap * map, Grid const * const grid) {
+    BitGrid const current = canonical_grid(bitgrid_from_grid(grid), nullptr);
+    if (bitgrid_has_won(current) != EMPTY || bitgrid_is_full(current)) {
+        return 0;
+    }
+    uint8_t const best = map_annotation(map, hash_grid(current));
+    return best == ANNOTATION_NONE ? GRID_TOTAL + 1 : annotation_plies(best);
+}
+#endif
+
+
+//Depth first alpha-beta search, for boards too big for the table.
+
+//Scores are for the side to move. A win scores 1 + the number of empty tiles left when the game ends,
+//so quicker wins score higher and slower losses score less badly. A draw is 0.
+//A score only depends on the position, not on how we got there, so table entries can be reused anywhere.
+enum {
+    SCORE_MAX = GRID_TOTAL + 1, //Above any real score
+    SEARCH_TABLE_SIZE = 1 << 20, //Entries, a power of two
+    SEARCH_BUCKET = 2, //Entries a position can go in
+    PARALLEL_MIN_EMPTIES = 10, //Smaller searches aren't worth starting threads for
+    BUDGET_CHECK_NODES = 1024, //Nodes between looks at the clock, for searches with a time limit
+};
+
+typedef enum Bound Bound;
+enum Bound {
+    BOUND_NONE = 0, //Empty entry
+    BOUND_EXACT = 1,
+    BOUND_LOWER = 2, //The score is at least value
+    BOUND_UPPER = 3, //The score is at most value
+};
+
+//The transposition table is shared by all the search threads, and has no locks.
+//An entry is two words, the data and the key xor the data, each read and written atomically.
+//If two threads write an entry at once, the words can come from different writes,
+//but then the key doesn't check out and the entry is just a miss.
+
+//Data layout: the value in bits 0-7, the bound in 8-9, the best move in 10-17,
+//and the depth searched in 18-25. A search to the end of the game has a depth of the number of empty tiles,
+//and a shallower one is only good for searches at most that deep.
+enum {
+    ENTRY_BOUND_SHIFT = 8,
+    ENTRY_MOVE_SHIFT = 10,
+    ENTRY_DEPTH_SHIFT = 18,
+};
+
+typedef struct SearchEntry SearchEntry;
+struct SearchEntry {
+    _Atomic uint64_t check; //key ^ data
+    _Atomic uint64_t data;
+};
+
+//A position can go in either entry of its bucket. The first one keeps the biggest subtree
+//(the deepest search) that maps there, and the second one takes everything else.
+//So the expensive results stay, and the recent ones still get a place.
+typedef struct Search Search;
+struct Search {
+    SearchEntry* table; //SEARCH_TABLE_SIZE entries
+    bool owns_table; //False for the helper threads, who share the main search's table
+    atomic_bool* stop; //Set when a helper should give up, null for the main search
+    uint64_t nodes; //Moves played since the last clear
+    //Table counters since the last clear
+    uint64_t hits; //Probes that found their position
+    uint64_t misses; //Probes that didn't
+    uint64_t collisions; //Misses where the bucket was full of other positions
+    uint64_t overwrites; //Stores that threw out another position
+    //Budget per move for search_position, 0 for none. With one it deepens the search a ply at a time,
+    //and plays the best move of the last depth it finished.
+    double move_time; //Seconds
+    uint64_t move_nodes;
+    size_t threads; //For search_position, 0 for one per core
+    //What the last search_position got done
+    bool complete; //It searched to the end of the game, so its score is exact
+    size_t depth; //Plies deep it finished
+    //State of the search in progress
+    double deadline; //seconds_now() to stop at, 0 for none
+    uint64_t node_limit; //nodes to stop at, 0 for none
+    uint64_t next_check; //nodes to look at the clock again at
+    bool out_of_budget;
+    bool horizon; //The search stopped short of the end of the game somewhere
+};
+
+//Returns null on allocation error.
+//The search gets its own table if table is null, and shares the given one otherwise.
+Search* init_search_with(Search* s, SearchEntry* table) {
+    if (s) {
+        init_tables();
+        s->owns_table = !table;
+        s->stop = nullptr;
+        s->nodes = 0;
+        s->hits = 0;
+        s->misses = 0;
+        s->collisions = 0;
+        s->overwrites = 0;
+        s->move_time = 0;
+        s->move_nodes = 0;
+        s->threads = 0;
+        s->complete = false;
+        s->depth = 0;
+        s->deadline = 0;
+        s->node_limit = 0;
+        s->next_check = 0;
+        s->out_of_budget = false;
+        s->horizon = false;
+        //Zeroed entries are BOUND_NONE.
+        if (!(s->table = table ? table : calloc(SEARCH_TABLE_SIZE, sizeof(SearchEntry)))) {
+            return nullptr;
+        }
+    }
+    return s;
+}
+
+Search* init_search(Search* s) {
+    return init_search_with(s, nullptr);
+}
+
+Search* new_search() {
+    Search* s = malloc(sizeof(Search));
+    if (s && !init_search(s)) {
+        free(s);
+        return nullptr;
+    }
+    return s;
+}
+
+//Forgets every entry.
+void clear_search(Search* s) {
+    memset(s->table, 0, SEARCH_TABLE_SIZE * sizeof(SearchEntry));
+    s->nodes = 0;
+    s->hits = 0;
+    s->misses = 0;
+    s->collisions = 0;
+    s->overwrites = 0;
+}
+
+//Only use from new_search!
+void destroy_search(Search* s) {
+    if (s) {
+        if (s->owns_table) {
+            free(s->table);
+        }
+        free(s);
+    }
+}
+
+//Adds the counters of helper to s.
+void add_search_counters(Search* s, Search const * const helper) {
+    s->nodes += helper->nodes;
+    s->hits += helper->hits;
+    s->misses += helper->misses;
+    s->collisions += helper->collisions;
+    s->overwrites += helper->overwrites;
+}
+
+uint64_t pack_entry(int value, Bound bound, size_t move, size_t depth) {
+    return (uint64_t) (uint8_t) (int8_t) value | (uint64_t) bound << ENTRY_BOUND_SHIFT
+        | (uint64_t) move << ENTRY_MOVE_SHIFT | (uint64_t) depth << ENTRY_DEPTH_SHIFT;
+}
+
+Bound entry_bound(uint64_t const data) {
+    return (Bound) (data >> ENTRY_BOUND_SHIFT & 3);
+}
+
+size_t entry_depth(uint64_t const data) {
+    return data >> ENTRY_DEPTH_SHIFT & 0xFF;
+}
+
+//Returns the data stored for key, or 0 (BOUND_NONE) if there is none.
+uint64_t probe_table(Search* s, uint64_t const key) {
+    SearchEntry* bucket = &s->table[key & (SEARCH_TABLE_SIZE - SEARCH_BUCKET)];
+    size_t used = 0;
+    for (size_t i = 0; i < SEARCH_BUCKET; i++) {
+        uint64_t const data = atomic_load_explicit(&bucket[i].data, memory_order_relaxed);
+        uint64_t const check = atomic_load_explicit(&bucket[i].check, memory_order_relaxed);
+        if (entry_bound(data) == BOUND_NONE) {
+            continue;
+        } else if ((check ^ data) == key) {
+            s->hits++;
+            return data;
+        }
+        used++;
+    }
+    s->misses++;
+    s->collisions += used == SEARCH_BUCKET;
+    return 0;
+}
+
+void store_table(Search* s, uint64_t const key, uint64_t const data) {
+    SearchEntry* bucket = &s->table[key & (SEARCH_TABLE_SIZE - SEARCH_BUCKET)];
+    uint64_t const kept = atomic_load_explicit(&bucket[0].data, memory_order_relaxed);
+    uint64_t const kept_check = atomic_load_explicit(&bucket[0].check, memory_order_relaxed);
+    //The first entry if it's this position, or a smaller one, and the second entry otherwise.
+    SearchEntry* entry = &bucket[1];
+    if ((kept_check ^ kept) == key || entry_depth(data) >= entry_depth(kept)) {
+        entry = &bucket[0];
+    }
+    uint64_t const old = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t const old_check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    s->overwrites += entry_bound(old) != BOUND_NONE && (old_check ^ old) != key;
+    atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+//True once a helper's result isn't wanted any more, or the search has used up its budget for the move.
+//Once it's true it stays true, so a stopped search doesn't store anything on the way back up.
+bool search_stopped(Search* s) {
+    if (s->stop && atomic_load_explicit(s->stop, memory_order_relaxed)) {
+        return true;
+    }
+    if (!s->out_of_budget && s->node_limit && s->nodes >= s->node_limit) {
+        s->out_of_budget = true;
+    }
+    if (!s->out_of_budget && s->deadline > 0 && s->nodes >= s->next_check) {
+        s->next_check = s->nodes + BUDGET_CHECK_NODES;
+        s->out_of_budget = seconds_now() >= s->deadline;
+    }
+    return s->out_of_budget;
+}
+
+WinState score_to_state(int const score, Player const p) {
+    if (score > 0) {
+        return (WinState) p;
+    } else if (score < 0) {
+        return (WinState) next_player(p);
+    }
+    return DRAW;
+}
+
+//Moves left in the game with best play, for a position with empties empty tiles and this score.
+size_t score_to_plies(int const score, size_t const empties) {
+    //A draw fills the board, and a win leaves score - 1 empty tiles.
+    return score == 0 ? empties : empties - (abs(score) - 1);
+}
+
+//Move ordering: the moves in allowed, starting with first if it is one,
+//then in TILE_ORDER (the tiles on the most lines first) from offset.
+//Moves come out one at a time, so a cut off skips the rest without generating them.
+typedef struct MoveOrder MoveOrder;
+struct MoveOrder {
+    BitMask left; //Moves not given out yet
+    size_t first;
+    size_t offset;
+    size_t i; //Next place in TILE_ORDER
+};
+
+MoveOrder move_order(BitMask const allowed, size_t const first, size_t const offset) {
+    return (MoveOrder) {allowed, first, offset, 0};
+}
+
+//Returns the next move, or GRID_TOTAL when there are none left.
+size_t next_move(MoveOrder* order) {
+    if (order->first < GRID_TOTAL && (order->left & ((BitMask) 1 << order->first))) {
+        order->left &= ~((BitMask) 1 << order->first);
+        return order->first;
+    }
+    while (order->left && order->i < GRID_TOTAL) {
+        size_t const t = TILE_ORDER[(order->i++ + order->offset) % GRID_TOTAL];
+        if (order->left & ((BitMask) 1 << t)) {
+            order->left &= ~((BitMask) 1 << t);
+            return t;
+        }
+    }
+    return GRID_TOTAL;
+}
+
+int negamax(Search* s, Grid* g, size_t empties, size_t depth, int alpha, int beta);
+
+//Plays tile t on g, searches it, and takes it back, so g is the same afterwards.
+//Returns the score for the side that played it. empties is the number of empty tiles on g,
+//and depth the plies to search, this move included. Past that a position scores 0, as if it were a draw.
+int search_move(Search* s, Grid* g, size_t t, size_t empties, size_t depth, int alpha, int beta) {
+    size_t const x = t % GRID_X_DIM;
+    size_t const y = t / GRID_X_DIM;
+    move(g, x, y);
+    s->nodes++;
+    int score = 0;
+    if (is_winning_move(g, x, y)) {
+        score = (int) empties; //1 + the empty tiles left after this one
+    } else if (empties > 1 && depth > 1) {
+        score = -negamax(s, g, empties - 1, depth - 1, -beta, -alpha);
+    } else if (empties > 1) {
+        s->horizon = true;
+    }
+    unmove(g, x, y);
+    return score;
+}
+
+//Returns the score of g for the side to move, as far as alpha and beta need it:
+//a score <= alpha is only an upper bound, and a score >= beta only a lower bound.
+//g must not be a finished game, and empties is its number of empty tiles. depth is the plies to search,
+//at most empties, which searches to the end of the game.
+//Moves are made and taken back on g, which is left as it was.
+int negamax(Search* s, Grid* g, size_t empties, size_t depth, int alpha, int beta) {
+    if (search_stopped(s)) {
+        return 0;
+    }
+    BitGrid const b = bitgrid_from_grid(g);
+    Player const player = bitgrid_player(b);
+
+    //Take a win if there is one. Otherwise we have to block the opponent's wins,
+    //and if there are two of them we lose to the next move.
+    BitMask const wins = bitgrid_threats(b, player);
+    if (wins) {
+        return (int) empties;
+    }
+    BitMask const blocks = bitgrid_threats(b, next_player(player));
+    if (count_tiles(blocks) > 1) {
+        return 1 - (int) empties;
+    }
+    if (bitgrid_is_dead(b)) {
+        return 0;
+    }
+
+    //At best we win with our next move, at worst we lose to the one after.
+    //Near the end of the game there may not be enough moves left for that, and it is a draw at worst.
+    int const best_possible = empties >= 3 ? (int) empties - 2 : 0;
+    int const worst_possible = empties >= 4 ? 3 - (int) empties : 0;
+    if (beta > best_possible) {
+        beta = best_possible;
+    }
+    if (alpha < worst_possible) {
+        alpha = worst_possible;
+    }
+    if (alpha >= beta) {
+        return alpha;
+    }
+
+    uint64_t const key = g->key;
+    uint64_t const entry = probe_table(s, key);
+    size_t table_move = GRID_TOTAL;
+    if (entry_bound(entry) != BOUND_NONE) {
+        int const value = (int8_t) (entry & 0xFF);
+        Bound const bound = entry_bound(entry);
+        //A shallower entry's score won't do, but its move is still the best guess.
+        if (entry_depth(entry) >= depth && (bound == BOUND_EXACT
+            || (bound == BOUND_LOWER && value >= beta)
+            || (bound == BOUND_UPPER && value <= alpha))) {
+            s->horizon |= entry_depth(entry) < empties;
+            return value;
+        }
+        table_move = entry >> ENTRY_MOVE_SHIFT & 0xFF;
+    }
+
+    int const alpha_start = alpha;
+    int best = -SCORE_MAX;
+    size_t best_move = GRID_TOTAL;
+    //A forced block is the only move. Otherwise the table's move first, then the tiles on the most lines.
+    MoveOrder order = move_order(blocks ? blocks : bitgrid_empty(b), table_move, 0);
+    for (size_t t = next_move(&order); t < GRID_TOTAL; t = next_move(&order)) {
+        int const score = search_move(s, g, t, empties, depth, alpha, beta);
+        if (score > best) {
+            best = score;
+            best_move = t;
+            if (score > alpha) {
+                alpha = score;
+            }
+            if (alpha >= beta) {
+                break; //Cut off, the opponent won't allow this position
+            }
+        }
+    }
+
+    //A stopped helper's scores are garbage, so they mustn't get into the table.
+    if (search_stopped(s)) {
+        return 0;
+    }
+    Bound const bound = best <= alpha_start ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+    store_table(s, key, pack_entry(best, bound, best_move, depth));
+    return best;
+}
+
+//Searches every move from grid, which has empties empty tiles, depth plies deep.
+//It starts with *best if that's a move, then goes on from the one at offset in TILE_ORDER.
+//Returns the best score and sets best to its move. If the search is stopped, that's the best of the moves it finished.
+int search_root(Search* s, Grid const * const grid, size_t empties, size_t depth, size_t offset, size_t* best) {
+    //The one copy of the board for the whole search.
+    Grid board;
+    copy_grid_into(grid, &board);
+    int alpha = -SCORE_MAX;
+    MoveOrder order = move_order(bitgrid_empty(bitgrid_from_grid(grid)), *best, offset);
+    for (size_t t = next_move(&order); t < GRID_TOTAL; t = next_move(&order)) {
+        int const score = search_move(s, &board, t, empties, depth, alpha, SCORE_MAX);
+        if (search_stopped(s)) {
+            break;
+        } else if (score > alpha) {
+            alpha = score;
+            *best = t;
+        }
+    }
+    return alpha;
+}
+
+//Lazy SMP: helper threads search the same position as the main one, each starting with a different move,
+//and share what they find through the table. Only the main search's answer is used,
+//and the helpers are stopped once it has it.
+typedef struct SearchHelper SearchHelper;
+struct SearchHelper {
+    Search search;
+    Grid const* grid;
+    size_t empties;
+    size_t depth;
+    size_t offset;
+};
+
+#if HAVE_THREADS
+int search_helper_thread(void* arg) {
+    SearchHelper* helper = arg;
+    size_t best = GRID_TOTAL;
+    search_root(&helper->search, helper->grid, helper->empties, helper->depth, helper->offset, &best);
+    return 0;
+}
+#endif
+
+//search_root from grid depth plies deep, on s->threads threads if it's big enough.
+//The helpers' counters are added to s.
+int search_threads(Search* s, Grid const * const grid, size_t empties, size_t depth, size_t* best) {
+#if HAVE_THREADS
+    size_t const threads = empties >= PARALLEL_MIN_EMPTIES ? thread_count(s->threads) : 1;
+    if (threads > 1) {
+        atomic_bool stop;
+        atomic_init(&stop, false);
+        SearchHelper* helpers = calloc(threads, sizeof(SearchHelper));
+        thrd_t* handles = calloc(threads, sizeof(thrd_t));
+        bool* started = calloc(threads, sizeof(bool));
+        for (size_t t = 1; helpers && handles && started && t < threads; t++) {
+            init_search_with(&helpers[t].search, s->table);
+            helpers[t].search.stop = &stop;
+            helpers[t].grid = grid;
+            helpers[t].empties = empties;
+            helpers[t].depth = depth;
+            helpers[t].offset = t;
+            //If a thread doesn't start, the others just have to do without it.
+            started[t] = thrd_create(&handles[t], search_helper_thread, &helpers[t]) == thrd_success;
+        }
+        int const score = search_root(s, grid, empties, depth, 0, best);
+        atomic_store(&stop, true);
+        for (size_t t = 1; started && t < threads; t++) {
+            if (started[t]) {
+                thrd_join(handles[t], nullptr);
+                add_search_counters(s, &helpers[t].search);
+                s->horizon |= helpers[t].search.horizon;
+            }
+        }
+        free(helpers);
+        free(handles);
+        free(started);
+        return score;
+    }
+#endif
+    return search_root(s, grid, empties, depth, 0, best);
+}
+
+//Returns the score of grid for the side to move, and sets best to a move that gets it.
+//If the game is already over, returns -SCORE_MAX and sets best to GRID_TOTAL.
+//Without a budget it searches to the end of the game. With one it searches 1 ply deep, then 2, and so on,
+//with the table's moves from each depth ordering the next, until it gets to the end of the game
+//or the budget runs out. Then it returns the score and move of the last depth it finished,
+//where 0 can also mean it doesn't know. s->complete and s->depth say how far it got.
+int search_position(Search* s, Grid const * const grid, size_t* best) {
+    *best = GRID_TOTAL;
+    s->complete = true;
+    s->depth = 0;
+    if (has_won(grid) != EMPTY || is_full(grid)) {
+        return -SCORE_MAX;
+    }
+    size_t const empties = GRID_TOTAL - grid->pieces;
+    if (!s->move_time && !s->move_nodes) {
+        s->depth = empties;
+        return search_threads(s, grid, empties, empties, best);
+    }
+
+    s->deadline = s->move_time ? seconds_now() + s->move_time : 0;
+    s->node_limit = s->move_nodes ? s->nodes + s->move_nodes : 0;
+    s->next_check = s->nodes;
+    s->out_of_budget = false;
+    s->complete = false;
+    //Always have a move, even if not a single depth gets finished.
+    MoveOrder order = move_order(bitgrid_empty(bitgrid_from_grid(grid)), GRID_TOTAL, 0);
+    *best = next_move(&order);
+    int score = 0;
+    for (size_t depth = 1; depth <= empties; depth++) {
+        s->horizon = false;
+        size_t move = *best; //The last depth's move goes first
+        int const value = search_threads(s, grid, empties, depth, &move);
+        if (search_stopped(s)) {
+            break;
+        }
+        score = value;
+        *best = move;
+        s->depth = depth;
+        //Nothing was cut off by the depth, so deeper searches would find the same.
+        if (!s->horizon) {
+            s->complete = true;
+            break;
+        }
+    }
+    s->deadline = 0;
+    s->node_limit = 0;
+    s->out_of_budget = false;
+    return score;
+}
+
+/*
+Same as best_move_from_map, but searches instead of looking up a solved table.
+Returns an integer 0 <= t < GRID_TOTAL, or GRID_TOTAL if the game is over.
+Among the best moves it takes the quickest win, or the slowest loss.
+*/
+size_t best_move_from_search(Search* s, Grid const * const grid) {
+    size_t best = GRID_TOTAL;
+    search_position(s, grid, &best);
+    return best;
+}
+
+
+//Pondering: while the opponent thinks, a thread searches every reply they could make,
+//the likeliest first, into the search's table. When the real move comes, its answer may be
+//known already, and if not, the search starts with a warm table.
+typedef struct Ponder Ponder;
+struct Ponder {
+    Search search; //Shares the main search's table
+    Grid grid; //The position the opponent is thinking about
+    atomic_bool stop;
+    bool running;
+    double started;
+    double pondered; //Seconds it ran, set when it's stopped
+#if HAVE_THREADS
+    thrd_t thread;
+#endif
+    //Per reply, only read once the thread has been joined
+    bool done[GRID_TOTAL]; //The reply was searched to the end
+    size_t best[GRID_TOTAL]; //The best answer to it, if done
+    uint64_t nodes[GRID_TOTAL]; //Nodes spent on it
+};
+
+//How much of the work for a move was done while the opponent thought.
+typedef struct PonderReport PonderReport;
+struct PonderReport {
+    bool hit; //The answer was known already, so no search was needed
+    double pondered; //Seconds pondered while the opponent thought
+    double searched; //Seconds searched after the move arrived
+    uint64_t hidden_nodes; //Nodes spent on this reply while pondering
+    uint64_t nodes; //Nodes searched after the move arrived
+};
+
+//The share of the move's search that pondering hid, 0 to 1.
+double ponder_hidden(PonderReport const * const r) {
+    uint64_t const total = r->hidden_nodes + r->nodes;
+    return total ? (double) r->hidden_nodes / total : 0;
+}
+
+#if HAVE_THREADS
+int ponder_thread(void* arg) {
+    Ponder* p = arg;
+    //The search that led here stored the reply it expected, so that goes first.
+    uint64_t const entry = probe_table(&p->search, p->grid.key);
+    size_t const expected = entry_bound(entry) != BOUND_NONE ? entry >> ENTRY_MOVE_SHIFT & 0xFF : GRID_TOTAL;
+    size_t const empties = GRID_TOTAL - p->grid.pieces;
+    MoveOrder order = move_order(bitgrid_empty(bitgrid_from_grid(&p->grid)), expected, 0);
+    for (size_t t = next_move(&order); t < GRID_TOTAL && !search_stopped(&p->search); t = next_move(&order)) {
+        size_t const x = t % GRID_X_DIM;
+        size_t const y = t / GRID_X_DIM;
+        move(&p->grid, x, y);
+        if (!is_winning_move(&p->grid, x, y) && empties > 1) {
+            uint64_t const before = p->search.nodes;
+            p->best[t] = GRID_TOTAL;
+            search_root(&p->search, &p->grid, empties - 1, empties - 1, 0, &p->best[t]);
+            p->nodes[t] = p->search.nodes - before;
+            p->done[t] = !search_stopped(&p->search);
+        }
+        unmove(&p->grid, x, y);
+    }
+    return 0;
+}
+#endif
+
+//Starts pondering on grid, where it's the opponent's turn, with s's table.
+//Does nothing if threads aren't available or the game is over.
+void start_pondering(Ponder* p, Search* s, Grid const * const grid) {
+    init_search_with(&p->search, s->table);
+    p->search.stop = &p->stop;
+    atomic_init(&p->stop, false);
+    copy_grid_into(grid, &p->grid);
+    p->running = false;
+    p->pondered = 0;
+    memset(p->done, 0, sizeof(p->done));
+    memset(p->nodes, 0, sizeof(p->nodes));
+#if HAVE_THREADS
+    if (has_won(grid) == EMPTY && !is_full(grid)) {
+        p->started = seconds_now();
+        p->running = thrd_create(&p->thread, ponder_thread, p) == thrd_success;
+    }
+#endif
+}
+
+//Stops pondering and adds its counters to s. Does nothing if it isn't running.
+void stop_pondering(Ponder* p, Search* s) {
+#if HAVE_THREADS
+    if (p->running) {
+        atomic_store(&p->stop, true);
+        p->pondered = seconds_now() - p->started;
+        thrd_join(p->thread, nullptr);
+        p->running = false;
+        add_search_counters(s, &p->search);
+    }
+#endif
+}
+
+/*
+Same as best_move_from_search, for grid, which is the pondered position after the opponent played reply.
+Stops pondering, then uses its answer if it has one, and searches otherwise.
+If report isn't null, it is filled in with how much of the work pondering did.
+*/
+size_t best_move_from_ponder(Ponder* p, Search* s, Grid const * const grid, size_t reply, PonderReport* report) {
+    stop_pondering(p, s);
+    //Make sure grid really is the pondered position plus reply.
+    bool pondered = reply < GRID_TOTAL && p->grid.data[reply] == EMPTY;
+    if (pondered) {
+        Grid played;
+        copy_grid_into(&p->grid, &played);
+        move(&played, reply % GRID_X_DIM, reply / GRID_X_DIM);
+        pondered = played.key == grid->key;
+    }
+    PonderReport r = {
+        .hit = pondered && p->done[reply],
+        .pondered = p->pondered,
+        .hidden_nodes = pondered ? p->nodes[reply] : 0,
+    };
+    size_t best = r.hit ? p->best[reply] : GRID_TOTAL;
+    if (!r.hit) {
+        uint64_t const before = s->nodes;
+        double const begin = seconds_now();
+        best = best_move_from_search(s, grid);
+        r.searched = seconds_now() - begin;
+        r.nodes = s->nodes - before;
+    }
+    if (report) {
+        *report = r;
+    }
+    return best;
+}
+
+//Monte Carlo tree search, for boards too big to search to the end.
+//Each playout walks down the tree by UCT, picking the child with the best mix of results so far
+//and few visits, then plays random moves on the bitboard to the end of the game, and adds the result
+//to every node on the way down. The most visited move at the root is the one played.
+//Threads share the tree without locks. A thread counts its visit to a node on the way down,
+//before it has a result, so for now it counts as a loss (a virtual loss), and other threads go elsewhere.
+
+enum {
+    MCTS_POOL_NODES = 1 << 22, //Nodes in the tree's pool, the tree stops growing when it's used up
+    MCTS_EXPAND_VISITS = 4, //Visits a leaf needs before it gets children
+    MCTS_DEFAULT_PLAYOUTS = 1 << 18, //Per move, when there is no other budget
+    MCTS_CLOCK_PLAYOUTS = 64, //Playouts between looks at the clock
+};
+
+#define MCTS_EXPANDING UINT32_MAX
+//How much UCT favours moves it hasn't tried much over moves that have done well.
+static double const MCTS_EXPLORATION = 1.0;
+
+typedef struct MctsNode MctsNode;
+struct MctsNode {
+    _Atomic uint32_t children; //Pool index of the first child, 0 until expanded, MCTS_EXPANDING while a thread does it
+    _Atomic uint32_t visits; //Playouts through here, the ones still running included
+    _Atomic uint32_t points; //For the side that moved here: 2 for each win, 1 for each draw
+    uint8_t move; //Tile played to get here
+    uint8_t child_count; //Set before children is
+};
+
+typedef struct Mcts Mcts;
+struct Mcts {
+    MctsNode* pool; //MCTS_POOL_NODES nodes, the root is the first
+    atomic_uint_least32_t used; //Nodes given out
+    BitGrid root;
+    //Budget per move, both 0 for MCTS_DEFAULT_PLAYOUTS
+    double move_time; //Seconds
+    uint64_t move_playouts;
+    size_t threads; //For best_move_from_mcts, 0 for one per core
+    //State of the search in progress
+    double deadline; //seconds_now() to stop at, 0 for none
+    uint64_t limit; //Playouts to stop at, 0 for none
+    atomic_ullong playouts; //Playouts started
+    atomic_bool out_of_time;
+    uint64_t seed; //For the threads' random numbers, changes every move
+};
+
+//The budget is per move, see Mcts. Returns null on allocation error.
+Mcts* new_mcts(double move_time, uint64_t move_playouts) {
+    init_tables();
+    Mcts* m = malloc(sizeof(Mcts));
+    if (m && !(m->pool = malloc(MCTS_POOL_NODES * sizeof(MctsNode)))) {
+        free(m);
+        return nullptr;
+    }
+    if (m) {
+        atomic_init(&m->used, 1);
+        m->move_time = move_time;
+        m->move_playouts = move_playouts;
+        m->threads = 0;
+        m->seed = 0;
+    }
+    return m;
+}
+
+void destroy_mcts(Mcts* m) {
+    if (m) {
+        free(m->pool);
+        free(m);
+    }
+}
+
+//Gives node a child for every empty tile of b, the tiles on the most lines first.
+//Only one thread gets to, the others keep treating it as a leaf until it's done.
+//Returns the index of the first child, or 0 if it's someone else's or the pool is used up.
+uint32_t mcts_expand(Mcts* m, MctsNode* node, BitGrid const b) {
+    uint32_t expected = 0;
+    if (!atomic_compare_exchange_strong(&node->children, &expected, MCTS_EXPANDING)) {
+        return 0;
+    }
+    BitMask const empty = bitgrid_empty(b);
+    size_t const count = count_tiles(empty);
+    uint32_t const first = atomic_fetch_add(&m->used, (uint32_t) count);
+    if (first + count > MCTS_POOL_NODES) {
+        //Stays a leaf for good.
+        return 0;
+    }
+    size_t i = first;
+    for (size_t o = 0; o < GRID_TOTAL; o++) {
+        if (empty & ((BitMask) 1 << TILE_ORDER[o])) {
+            MctsNode* child = &m->pool[i++];
+            atomic_init(&child->children, 0);
+            atomic_init(&child->visits, 0);
+            atomic_init(&child->points, 0);
+            child->move = TILE_ORDER[o];
+            child->child_count = 0;
+        }
+    }
+    node->child_count = (uint8_t) count;
+    atomic_store_explicit(&node->children, first, memory_order_release);
+    return first;
+}
+
+//The child of node, which has visits visits, with the best UCT value. Children nobody has visited go first.
+MctsNode* mcts_select(Mcts* m, MctsNode const * const node, uint32_t first, uint32_t visits) {
+    double const log_visits = log((double) visits + 1);
+    MctsNode* best = nullptr;
+    double best_value = -1;
+    for (size_t c = 0; c < node->child_count; c++) {
+        MctsNode* child = &m->pool[first + c];
+        uint32_t const child_visits = atomic_load_explicit(&child->visits, memory_order_relaxed);
+        if (child_visits == 0) {
+            return child;
+        }
+        uint32_t const points = atomic_load_explicit(&child->points, memory_order_relaxed);
+        double const value = points / (2.0 * child_visits) + MCTS_EXPLORATION * sqrt(log_visits / child_visits);
+        if (value > best_value) {
+            best_value = value;
+            best = child;
+        }
+    }
+    return best;
+}
+
+//Plays random moves from b to the end of the game, and returns the winner, or EMPTY for a draw.
+Player mcts_rollout(BitGrid b, uint64_t* random) {
+    uint8_t tiles[GRID_TOTAL];
+    size_t count = 0;
+    for (BitMask m = bitgrid_empty(b); m; m &= m - 1) {
+        tiles[count++] = lowest_tile(m);
+    }
+    while (count) {
+        size_t const i = next_random(random) % count;
+        size_t const t = tiles[i];
+        tiles[i] = tiles[--count];
+        bool const o_moved = b.o_turn;
+        b = bitgrid_move(b, t);
+        if (mask_has_line(o_moved ? b.o : b.x)) {
+            return o_moved ? O_PL : X_PL;
+        }
+    }
+    return EMPTY;
+}
+
+//One playout from the root: down the tree, a random game from the leaf, and the result back up.
+void mcts_playout(Mcts* m, uint64_t* random) {
+    MctsNode* path[GRID_TOTAL + 1];
+    size_t length = 0;
+    BitGrid b = m->root;
+    MctsNode* node = &m->pool[0];
+    atomic_fetch_add_explicit(&node->visits, 1, memory_order_relaxed);
+    path[length++] = node;
+    Player winner = EMPTY;
+    bool over = false;
+    while (!over) {
+        uint32_t const visits = atomic_load_explicit(&node->visits, memory_order_relaxed);
+        uint32_t first = atomic_load_explicit(&node->children, memory_order_acquire);
+        if (first == 0 && visits >= MCTS_EXPAND_VISITS) {
+            first = mcts_expand(m, node, b);
+        }
+        if (first == 0 || first == MCTS_EXPANDING) {
+            break;
+        }
+        node = mcts_select(m, node, first, visits);
+        atomic_fetch_add_explicit(&node->visits, 1, memory_order_relaxed);
+        path[length++] = node;
+        bool const o_moved = b.o_turn;
+        b = bitgrid_move(b, node->move);
+        if (mask_has_line(o_moved ? b.o : b.x)) {
+            winner = o_moved ? O_PL : X_PL;
+            over = true;
+        } else if (bitgrid_is_full(b)) {
+            over = true;
+        }
+    }
+    if (!over) {
+        winner = mcts_rollout(b, random);
+    }
+    //path[i] was moved to by the side to move at the root for odd i, and by the other side for even i.
+    Player const root_player = bitgrid_player(m->root);
+    for (size_t i = 1; i < length; i++) {
+        Player const mover = i % 2 ? root_player : next_player(root_player);
+        uint32_t const points = winner == EMPTY ? 1 : winner == mover ? 2 : 0;
+        atomic_fetch_add_explicit(&path[i]->points, points, memory_order_relaxed);
+    }
+}
+
+typedef struct MctsWorker MctsWorker;
+struct MctsWorker {
+    Mcts* mcts;
+    uint64_t random;
+};
+
+//Runs playouts until the budget is used up.
+int mcts_worker(void* arg) {
+    MctsWorker* worker = arg;
+    Mcts* m = worker->mcts;
+    while (!atomic_load_explicit(&m->out_of_time, memory_order_relaxed)) {
+        uint64_t const n = atomic_fetch_add_explicit(&m->playouts, 1, memory_order_relaxed);
+        if (m->limit && n >= m->limit) {
+            break;
+        } else if (m->deadline > 0 && n % MCTS_CLOCK_PLAYOUTS == 0 && seconds_now() >= m->deadline) {
+            atomic_store(&m->out_of_time, true);
+            break;
+        }
+        mcts_playout(m, &worker->random);
+    }
+    return 0;
+}
+
+//Searches grid, which must not be a finished game, on threads threads, with a new tree.
+//Returns the number of playouts.
+uint64_t mcts_run(Mcts* m, Grid const * const grid, size_t threads) {
+    m->root = bitgrid_from_grid(grid);
+    atomic_store(&m->used, 1);
+    atomic_init(&m->pool[0].children, 0);
+    atomic_init(&m->pool[0].visits, 0);
+    atomic_init(&m->pool[0].points, 0);
+    m->pool[0].child_count = 0;
+    m->limit = m->move_playouts || m->move_time ? m->move_playouts : MCTS_DEFAULT_PLAYOUTS;
+    m->deadline = m->move_time ? seconds_now() + m->move_time : 0;
+    atomic_store(&m->playouts, 0);
+    atomic_store(&m->out_of_time, false);
+    //The root always gets its children, so every playout picks a move.
+    mcts_expand(m, &m->pool[0], m->root);
+
+    MctsWorker* workers = calloc(threads, sizeof(MctsWorker));
+    if (!workers) {
+        threads = 1;
+    }
+    MctsWorker only;
+    MctsWorker* main_worker = workers ? &workers[0] : &only;
+    for (size_t t = 0; t < threads; t++) {
+        MctsWorker* worker = t ? &workers[t] : main_worker;
+        worker->mcts = m;
+        worker->random = next_random(&m->seed);
+    }
+#if HAVE_THREADS
+    thrd_t* handles = calloc(threads, sizeof(thrd_t));
+    bool* started = calloc(threads, sizeof(bool));
+    for (size_t t = 1; handles && started && t < threads; t++) {
+        //If a thread doesn't start, the others just have to do without it.
+        started[t] = thrd_create(&handles[t], mcts_worker, &workers[t]) == thrd_success;
+    }
+#endif
+    mcts_worker(main_worker);
+#if HAVE_THREADS
+    for (size_t t = 1; started && t < threads; t++) {
+        if (started[t]) {
+            thrd_join(handles[t], nullptr);
+        }
+    }
+    free(handles);
+    free(started);
+#endif
+    free(workers);
+    return atomic_load(&m->pool[0].visits);
+}
+
+//The most visited move at the root after mcts_run, or null if there's none.
+MctsNode const* mcts_best(Mcts const * const m) {
+    uint32_t const first = atomic_load(&m->pool[0].children);
+    if (first == 0 || first == MCTS_EXPANDING) {
+        return nullptr;
+    }
+    MctsNode const* best = nullptr;
+    for (size_t c = 0; c < m->pool[0].child_count; c++) {
+        MctsNode const* child = &m->pool[first + c];
+        if (!best || atomic_load(&child->visits) > atomic_load(&best->visits)) {
+            best = child;
+        }
+    }
+    return best;
+}
+
+/*
+Same as best_move_from_search, but with Monte Carlo tree search on m->threads threads.
+Returns an integer 0 <= t < GRID_TOTAL, or GRID_TOTAL if the game is over.
+The move is only the likeliest to do well, unlike the other engines.
+*/
+size_t best_move_from_mcts(Mcts* m, Grid const * const grid) {
+    if (has_won(grid) != EMPTY || is_full(grid)) {
+        return GRID_TOTAL;
+    }
+    mcts_run(m, grid, thread_count(m->threads));
+    MctsNode const* best = mcts_best(m);
+    return best ? best->move : GRID_TOTAL;
+}
+
+//Runs the search from the empty board on one thread, then on the given number of threads if that's more
+//(0 for one per core), and prints the move, how it did, and the playouts per second.
+int mcts_and_report(double move_time, uint64_t move_playouts, size_t threads) {
+    Mcts* m = new_mcts(move_time, move_playouts);
+    if (!m) {
+        printf("Allocation error\n");
+        return EXIT_FAILURE;
+    }
+    Grid start;
+    reset(&start);
+    threads = thread_count(threads);
+
+    printf("Solver: mcts\n");
+    double rates[2] = {0, 0};
+    size_t const runs = threads > 1 ? 2 : 1;
+    for (size_t r = 0; r < runs; r++) {
+        size_t const run_threads = r ? threads : 1;
+        double const begin = seconds_now();
+        uint64_t const playouts = mcts_run(m, &start, run_threads);
+        double const elapsed = seconds_now() - begin;
+        rates[r] = playouts / elapsed;
+        MctsNode const* best = mcts_best(m);
+        uint32_t const visits = atomic_load(&best->visits);
+        printf("Threads: %zu\n", run_threads);
+        printf("Best move: %zu %zu\n", (size_t) best->move % GRID_X_DIM, (size_t) best->move / GRID_X_DIM);
+        printf("Score: %.3f over %u playouts\n", atomic_load(&best->points) / (2.0 * visits), visits);
+        printf("Playouts: %llu\n", (unsigned long long) playouts);
+        uint32_t const used = atomic_load(&m->used);
+        printf("Tree nodes: %u\n", used < MCTS_POOL_NODES ? used : MCTS_POOL_NODES);
+        printf("Time: %.6f s\n", elapsed);
+        printf("Playouts per second: %.0f\n", rates[r]);
+    }
+    if (runs == 2) {
+        printf("Speedup: %.2fx\n", rates[1] / rates[0]);
+    }
+    destroy_mcts(m);
+    return EXIT_SUCCESS;
+}
+
+//Perft: counts every node of the game tree down to a given depth, with the same move, unmove
+//and win detection the game uses. The counts are known for 3x3 (549946 nodes, 5478 positions),
+//so it checks those, and it measures how fast they are.
+
+enum {
+    PERFT_KEY_SET_SIZE = 1 << 22, //Keys, a power of two, for boards too big to have a bit per board
+    PERFT_SPLIT_ITEMS = 16, //Work items per thread, for the parallel count
+};
+
+typedef struct PerftCounts PerftCounts;
+struct PerftCounts {
+    uint64_t nodes[GRID_TOTAL + 1]; //Positions reached after that many moves
+};
+
+//The positions seen so far, for counting the unique ones.
+//Dense boards have a bit for every board, by the base 3 index hash_grid uses.
+//Bigger boards keep Zobrist keys in a fixed size open addressing set, and give up counting if it fills.
+//Either way it is lock free, so every thread can add to it.
+typedef struct Perft Perft;
+struct Perft {
+    size_t depth;
+    _Atomic uint64_t* seen; //The bits, or the keys + 1, with 0 as a free slot
+    atomic_ullong unique;
+    atomic_bool overflow; //The key set filled up, so unique is too low
+    Grid* items; //Positions at the split depth, for the threads to share out
+    size_t item_count;
+    atomic_size_t next_item;
+};
+
+//Adds the position to the set, index being its base 3 index on dense boards.
+void perft_mark(Perft* p, Grid const * const g, size_t index) {
+#if GRID_DENSE
+    (void) g;
+    uint64_t const bit = (uint64_t) 1 << (index % 64);
+    if (!(atomic_fetch_or_explicit(&p->seen[index / 64], bit, memory_order_relaxed) & bit)) {
+        atomic_fetch_add_explicit(&p->unique, 1, memory_order_relaxed);
+    }
+#else
+    uint64_t const stored = g->key + 1;
+    for (size_t i = 0; i < PERFT_KEY_SET_SIZE; i++) {
+        _Atomic uint64_t* slot = &p->seen[(g->key + i) & (PERFT_KEY_SET_SIZE - 1)];
+        uint64_t found = 0;
+        if (atomic_compare_exchange_strong_explicit(slot, &found, stored, memory_order_relaxed, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&p->unique, 1, memory_order_relaxed);
+            return;
+        } else if (found == stored) {
+            return;
+        }
+    }
+    (void) index;
+    atomic_store(&p->overflow, true);
+#endif
+}
+
+//The base 3 index of g after the side to move plays t, from index, the index of g.
+size_t perft_child_index(Grid const * const g, size_t index, size_t t) {
+#if GRID_DENSE
+    return index + (g->player == X_PL ? 1 : 2) * POW3[t];
+#else
+    (void) g;
+    (void) index;
+    (void) t;
+    return 0;
+#endif
+}
+
+//Counts g, which is ply moves from the start, and everything under it.
+void perft_node(Perft* p, Grid* g, size_t ply, size_t index, PerftCounts* counts) {
+    counts->nodes[ply]++;
+    perft_mark(p, g, index);
+    if (ply == p->depth || has_won(g) != EMPTY || is_full(g)) {
+        return;
+    }
+    for (size_t t = 0; t < GRID_TOTAL; t++) {
+        if (g->data[t] != EMPTY) {
+            continue;
+        }
+        size_t const child = perft_child_index(g, index, t);
+        move(g, t % GRID_X_DIM, t / GRID_X_DIM);
+        perft_node(p, g, ply + 1, child, counts);
+        unmove(g, t % GRID_X_DIM, t / GRID_X_DIM);
+    }
+}
+
+//The base 3 index of a whole board.
+size_t perft_index(Grid const * const g) {
+    size_t index = 0;
+#if GRID_DENSE
+    for (size_t t = 0; t < GRID_TOTAL; t++) {
+        index += g->data[t] * POW3[t];
+    }
+#else
+    (void) g;
+#endif
+    return index;
+}
+
+//Counts the nodes above split_ply like perft_node, and saves the ones at split_ply as work items.
+//Returns false on allocation error.
+bool perft_split(Perft* p, Grid* g, size_t ply, size_t split_ply, size_t* capacity, PerftCounts* counts) {
+    if (ply == split_ply) {
+        if (p->item_count == *capacity) {
+            size_t const grown_capacity = *capacity ? 2 * *capacity : 64;
+            Grid* grown = realloc(p->items, grown_capacity * sizeof(Grid));
+            if (!grown) {
+                return false;
+            }
+            p->items = grown;
+            *capacity = grown_capacity;
+        }
+        copy_grid_into(g, &p->items[p->item_count++]);
+        return true;
+    }
+    counts->nodes[ply]++;
+    perft_mark(p, g, perft_index(g));
+    if (has_won(g) != EMPTY || is_full(g)) {
+        return true;
+    }
+    for (size_t t = 0; t < GRID_TOTAL; t++) {
+        if (g->data[t] != EMPTY) {
+            continue;
+        }
+        move(g, t % GRID_X_DIM, t / GRID_X_DIM);
+        bool const ok = perft_split(p, g, ply + 1, split_ply, capacity, counts);
+        unmove(g, t % GRID_X_DIM, t / GRID_X_DIM);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct PerftWorker PerftWorker;
+struct PerftWorker {
+    Perft* perft;
+    size_t split_ply;
+    PerftCounts counts;
+};
+
+int perft_worker(void* arg) {
+    PerftWorker* worker = arg;
+    Perft* p = worker->perft;
+    for (size_t i = atomic_fetch_add(&p->next_item, 1); i < p->item_count; i = atomic_fetch_add(&p->next_item, 1)) {
+        perft_node(p, &p->items[i], worker->split_ply, perft_index(&p->items[i]), &worker->counts);
+    }
+    return 0;
+}
+
+//Counts the game tree from start down to depth moves, on threads threads.
+//Fills in counts, and unique with the number of different positions, or 0 if they couldn't all be counted.
+//Returns false on allocation error.
+bool perft(Grid const * const start, size_t depth, size_t threads, PerftCounts* counts, uint64_t* unique) {
+    Perft p;
+    p.depth = depth;
+#if GRID_DENSE
+    size_t const seen_words = (STATE_TABLE_SIZE + 63) / 64;
+#else
+    size_t const seen_words = PERFT_KEY_SET_SIZE;
+#endif
+    p.seen = calloc(seen_words, sizeof(uint64_t));
+    atomic_init(&p.unique, 0);
+    atomic_init(&p.overflow, false);
+    p.items = nullptr;
+    p.item_count = 0;
+    atomic_init(&p.next_item, 0);
+    memset(counts, 0, sizeof(PerftCounts));
+    if (!p.seen) {
+        return false;
+    }
+
+    Grid board;
+    copy_grid_into(start, &board);
+#if HAVE_THREADS
+    if (threads > 1) {
+        //Go deeper until there are enough positions to keep every thread busy.
+        size_t split_ply = 1;
+        size_t capacity = 0;
+        bool ok = true;
+        while (ok && split_ply <= depth) {
+            p.item_count = 0;
+            memset(counts, 0, sizeof(PerftCounts));
+            ok = perft_split(&p, &board, 0, split_ply, &capacity, counts);
+            if (p.item_count >= PERFT_SPLIT_ITEMS * threads || split_ply == depth) {
+                break;
+            }
+            split_ply++;
+        }
+        PerftWorker* workers = calloc(threads, sizeof(PerftWorker));
+        thrd_t* handles = calloc(threads, sizeof(thrd_t));
+        bool* started = calloc(threads, sizeof(bool));
+        ok = ok && workers && handles && started;
+        for (size_t t = 1; ok && t < threads; t++) {
+            workers[t].perft = &p;
+            workers[t].split_ply = split_ply;
+            started[t] = thrd_create(&handles[t], perft_worker, &workers[t]) == thrd_success;
+        }
+        if (ok) {
+            workers[0].perft = &p;
+            workers[0].split_ply = split_ply;
+            perft_worker(&workers[0]);
+        }
+        for (size_t t = 0; ok && t < threads; t++) {
+            if (t > 0 && started[t]) {
+                thrd_join(handles[t], nullptr);
+            }
+            for (size_t d = 0; d <= GRID_TOTAL; d++) {
+                counts->nodes[d] += workers[t].counts.nodes[d];
+            }
+        }
+        free(workers);
+        free(handles);
+        free(started);
+        free(p.items);
+        if (!ok) {
+            free(p.seen);
+            return false;
+        }
+    } else
+#endif
+    {
+        perft_node(&p, &board, 0, perft_index(&board), counts);
+    }
+    *unique = atomic_load(&p.overflow) ? 0 : atomic_load(&p.unique);
+    free(p.seen);
+    return true;
+}
+
+//Runs perft from the empty board on one thread, and then on the given number of threads if that's more
+//(0 for one per core), and reports the counts and the speed. Fails if the two don't agree.
+int perft_and_report(size_t depth, size_t threads) {
+    Grid start;
+    reset(&start);
+    depth = depth < GRID_TOTAL ? depth : GRID_TOTAL;
+    threads = thread_count(threads);
+
+    PerftCounts counts[2];
+    uint64_t unique[2] = {0, 0};
+    double elapsed[2] = {0, 0};
+    size_t const runs = threads > 1 ? 2 : 1;
+    for (size_t r = 0; r < runs; r++) {
+        double const begin = seconds_now();
+        if (!perft(&start, depth, r == 0 ? 1 : threads, &counts[r], &unique[r])) {
+            printf("Allocation error\n");
+            return EXIT_FAILURE;
+        }
+        elapsed[r] = seconds_now() - begin;
+    }
+
+    uint64_t total = 0;
+    printf("Perft to depth %zu\n", depth);
+    printf("Depth  Nodes\n");
+    for (size_t d = 0; d <= depth; d++) {
+        printf("%5zu  %llu\n", d, (unsigned long long) counts[0].nodes[d]);
+        total += counts[0].nodes[d];
+    }
+    printf("Total nodes: %llu\n", (unsigned long long) total);
+    if (unique[0]) {
+        printf("Unique positions: %llu\n", (unsigned long long) unique[0]);
+    } else {
+        printf("Unique positions: too many to count\n");
+    }
+    printf("Threads: 1, time: %.6f s, nodes per second: %.0f\n", elapsed[0], total / elapsed[0]);
+    if (runs == 2) {
+        printf("Threads: %zu, time: %.6f s, nodes per second: %.0f, speedup: %.2fx\n",
+            threads, elapsed[1], total / elapsed[1], elapsed[0] / elapsed[1]);
+        if (memcmp(&counts[0], &counts[1], sizeof(PerftCounts)) != 0 || unique[0] != unique[1]) {
+            printf("Error, the parallel counts are different\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+//Stats API: the counters are cumulative, so reset_stats before a solve and print_stats after it.
+void reset_stats() {
+#ifdef SOLVER_STATS
+    atomic_store(&STATS.probes, 0);
+    atomic_store(&STATS.hits, 0);
+    atomic_store(&STATS.inserts, 0);
+    atomic_store(&STATS.expanded, 0);
+    atomic_store(&STATS.requeued, 0);
+    atomic_store(&STATS.allocations, 0);
+    atomic_store(&STATS.allocated_bytes, 0);
+    for (size_t i = 0; i < TOTAL_PHASES; i++) {
+        STATS.phase_time[i] = 0;
+    }
+#endif
+}
+
+//Prints the counters, and how full map's table is if it isn't null.
+//The table part is worked out here, so it is there even without SOLVER_STATS.
+void print_stats(FILE* out, GridStateMap const * const map) {
+#ifdef SOLVER_STATS
+    unsigned long long const probes = atomic_load(&STATS.probes);
+    unsigned long long const hits = atomic_load(&STATS.hits);
+    fprintf(out, "Table probes: %llu, hits: %llu (%.1f%%), inserts: %llu\n",
+        probes, hits, probes ? 100.0 * hits / probes : 0.0, (unsigned long long) atomic_load(&STATS.inserts));
+    fprintf(out, "Positions expanded: %llu, requeued: %llu\n",
+        (unsigned long long) atomic_load(&STATS.expanded), (unsigned long long) atomic_load(&STATS.requeued));
+    fprintf(out, "Allocations: %llu, %llu bytes\n",
+        (unsigned long long) atomic_load(&STATS.allocations), (unsigned long long) atomic_load(&STATS.allocated_bytes));
+    fprintf(out, "Phase time: search %.6f s, forward %.6f s, backward %.6f s\n",
+        STATS.phase_time[PHASE_SEARCH], STATS.phase_time[PHASE_FORWARD], STATS.phase_time[PHASE_BACKWARD]);
+#else
+    fprintf(out, "Build with -DSOLVER_STATS for the solver counters\n");
+#endif
+#if GRID_DENSE
+    if (!map) {
+        return;
+    }
+    //Occupancy: how many of each word's slots are used. The base 3 index leaves a lot of slots for
+    //boards that can't come up, or that aren't the canonical one of their symmetry class.
+    //Bucket 0 is the empty words, and bucket b > 0 has words with 8(b-1)+1 to 8b slots used.
+    size_t words_by_used[SLOTS_PER_WORD / 8 + 1] = {0};
+    for (size_t i = 0; i < STATE_TABLE_WORDS; i++) {
+        words_by_used[(word_slots_used(map->data[i]) + 7) / 8]++;
+    }
+    size_t const used = packed_count(map->data);
+    fprintf(out, "Slots used: %zu of %zu (%.2f%%)\n", used, (size_t) STATE_TABLE_SIZE, 100.0 * used / STATE_TABLE_SIZE);
+    fprintf(out, "Words by slots used: 0: %zu (%.1f%%)", words_by_used[0], 100.0 * words_by_used[0] / STATE_TABLE_WORDS);
+    for (size_t b = 1; b <= SLOTS_PER_WORD / 8; b++) {
+        fprintf(out, ", %zu-%zu: %zu (%.1f%%)", 8 * b - 7, 8 * b, words_by_used[b], 100.0 * words_by_used[b] / STATE_TABLE_WORDS);
+    }
+    fprintf(out, "\n");
+#else
+    (void) map;
+#endif
+}
+
+#if GRID_DENSE
+typedef WinState (*Solver)(GridStateMap* map, Grid const * const start_grid);
+
+//Solves from the empty board, and reports the result and the time it took, and the stats if stats is true.
+int solve_and_report(Solver solver, char const * const name, bool stats) {
+    reset_stats();
+    GridStateMap* mpt = new_map();
+    if (!mpt) {
+        printf("Allocation error\n");
+        return EXIT_FAILURE;
+    }
+    Grid start;
+    reset(&start);
+
+    double const begin = seconds_now();
+    WinState const state = solver(mpt, &start);
+    double const elapsed = seconds_now() - begin;
+
+    size_t const positions = packed_count(mpt->data);
+    printf("Solver: %s\n", name);
+    printf("Result: %s\n", state_to_string(state));
+    printf("Positions: %zu\n", positions);
+    if (plies_from_map(mpt, &start) <= GRID_TOTAL) {
+        printf("Game length: %zu moves\n", plies_from_map(mpt, &start));
+    }
+    printf("Table memory: %zu bytes\n", mpt->arena.reserved);
+    printf("Solver scratch: %zu bytes\n", mpt->scratch);
+    printf("Frontier peak: %zu positions, %zu bytes\n", mpt->frontier.peak, mpt->frontier.peak * sizeof(BitGrid));
+    printf("Time: %.6f s\n", elapsed);
+    if (stats) {
+        print_stats(stdout, mpt);
+    }
+    destroy_map(mpt);
+    return state == UNKNOWN ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//Solves from the empty board with the layered solver, and reports the time each layer took,
+//on the given number of threads (0 for one per core), and the speedup over solving on one thread
+//with baseline. The stats are for the layered solve.
+int solve_layered_and_report(Solver baseline, char const * const baseline_name, size_t threads, bool print) {
+    reset_stats();
+    GridStateMap* mpt = new_map();
+    if (!mpt) {
+        printf("Allocation error\n");
+        return EXIT_FAILURE;
+    }
+    Grid start;
+    reset(&start);
+    LayerStats stats;
+
+    double begin = seconds_now();
+    WinState const state = calculate_position_layered_on(mpt, &start, threads, &stats);
+    double const elapsed = seconds_now() - begin;
+
+    printf("Solver: layered\n");
+    printf("Threads: %zu\n", stats.threads);
+    printf("Result: %s\n", state_to_string(state));
+    printf("Positions: %zu\n", packed_count(mpt->data));
+    if (plies_from_map(mpt, &start) <= GRID_TOTAL) {
+        printf("Game length: %zu moves\n", plies_from_map(mpt, &start));
+    }
+    printf("Table memory: %zu bytes\n", mpt->arena.reserved);
+    printf("Solver scratch: %zu bytes\n", mpt->scratch);
+    printf("Time: %.6f s\n", elapsed);
+    printf("Pieces  Positions  Expand s  Solve s\n");
+    for (size_t i = 0; i <= GRID_TOTAL; i++) {
+        printf("%6zu  %9zu  %8.6f  %7.6f\n", i, stats.positions[i], stats.expand_time[i], stats.solve_time[i]);
+    }
+    if (print) {
+        print_stats(stdout, mpt);
+    }
+
+    reset_map(mpt);
+    begin = seconds_now();
+    WinState const baseline_state = baseline(mpt, &start);
+    double const baseline_elapsed = seconds_now() - begin;
+    printf("Baseline: %s, 1 thread\n", baseline_name);
+    printf("Baseline time: %.6f s\n", baseline_elapsed);
+    printf("Speedup: %.2fx\n", baseline_elapsed / elapsed);
+    destroy_map(mpt);
+    if (baseline_state != state) {
+        printf("Error, the baseline got %s\n", state_to_string(baseline_state));
+        return EXIT_FAILURE;
+    }
+    return state == UNKNOWN ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//Solution database: a solved table saved to a file, so it only has to be solved once.
+
+//The file is a DatabaseHeader followed by the table, then its ranks and annotations if it has them,
+//all in the byte order of the machine that wrote it. See annotation_index.
+//Everything in the header has to match this build, or the file is rejected.
+enum {
+    DATABASE_VERSION = 2, //1 had no annotations
+    DATABASE_ENCODING_PACKED = 2, //2 bits per slot, the same layout as GridStateMap. 1 was a byte per slot.
+    DATABASE_BYTE_ORDER = 0x01020304,
+};
+
+static char const DATABASE_MAGIC[8] = {'T', 'T', 'T', 'S', 'O', 'L', 'V', 'E'};
+
+typedef struct DatabaseHeader DatabaseHeader;
+struct DatabaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; //DATABASE_BYTE_ORDER as written
+    uint32_t x_dim;
+    uint32_t y_dim;
+    uint32_t k;
+    uint32_t encoding;
+    uint64_t entries; //Table slots after the header
+    uint64_t annotated; //Annotations after the ranks, 0 if there are no ranks or annotations
+    uint64_t checksum; //table_checksum of everything after the header
+};
+
+#define CHECKSUM_START ((uint64_t) 0xCBF29CE484222325u)
+
+//FNV-1a hash of data, carried on from hash, CHECKSUM_START for the first part.
+//Takes 8 bytes at a time so checking a big table on load stays quick.
+uint64_t table_checksum(uint64_t hash, uint8_t const * const data, size_t size) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3u;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3u;
+    }
+    return hash;
+}
+
+//Bytes of ranks and annotations after the table, for a file with annotated annotations.
+size_t database_annotation_bytes(size_t annotated) {
+    return annotated ? RANK_BLOCKS * sizeof(uint32_t) + annotated : 0;
+}
+
+//Checksum of a table, its ranks and annotated annotations, the last two of which can be null if there are none.
+uint64_t database_checksum(uint64_t const * const data, uint32_t const * const ranks, uint8_t const * const best, size_t annotated) {
+    uint64_t hash = table_checksum(CHECKSUM_START, (uint8_t const *) data, STATE_TABLE_BYTES);
+    if (annotated) {
+        hash = table_checksum(hash, (uint8_t const *) ranks, RANK_BLOCKS * sizeof(uint32_t));
+        hash = table_checksum(hash, best, annotated);
+    }
+    return hash;
+}
+
+//The header for this build's table, with the given annotation count and checksum.
+DatabaseHeader database_header(size_t annotated, uint64_t checksum) {
+    DatabaseHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATABASE_MAGIC, sizeof(header.magic));
+    header.version = DATABASE_VERSION;
+    header.byte_order = DATABASE_BYTE_ORDER;
+    header.x_dim = GRID_X_DIM;
+    header.y_dim = GRID_Y_DIM;
+    header.k = GRID_K;
+    header.encoding = DATABASE_ENCODING_PACKED;
+    header.entries = STATE_TABLE_SIZE;
+    header.annotated = annotated;
+    header.checksum = checksum;
+    return header;
+}
+
+//Writes the map's table, and its annotations if it has them, to path. Returns false on I/O error.
+bool write_database(GridStateMap const * const map, char const * const path) {
+    size_t const annotated = map->best ? map->annotated : 0;
+    DatabaseHeader const header = database_header(annotated, database_checksum(map->data, map->ranks, map->best, annotated));
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(map->data, 1, STATE_TABLE_BYTES, file) == STATE_TABLE_BYTES;
+    if (annotated) {
+        ok = ok && fwrite(map->ranks, sizeof(uint32_t), RANK_BLOCKS, file) == RANK_BLOCKS
+            && fwrite(map->best, 1, annotated, file) == annotated;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+//Returns null if the file contents are a table for this build, or else what's wrong with them.
+char const * check_database(uint8_t const * const bytes, size_t size) {
+    DatabaseHeader header;
+    if (size < sizeof(header)) {
+        return "file too short";
+    }
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, DATABASE_MAGIC, sizeof(header.magic)) != 0) {
+        return "not a solution database";
+    } else if (header.byte_order != DATABASE_BYTE_ORDER) {
+        return "written on a machine with another byte order";
+    } else if (header.version != DATABASE_VERSION || header.encoding != DATABASE_ENCODING_PACKED) {
+        return "unsupported version or encoding";
+    } else if (header.x_dim != GRID_X_DIM || header.y_dim != GRID_Y_DIM || header.k != GRID_K) {
+        return "made for another board size";
+    } else if (header.entries != STATE_TABLE_SIZE || header.annotated > STATE_TABLE_SIZE
+            || size != sizeof(header) + STATE_TABLE_BYTES + database_annotation_bytes(header.annotated)) {
+        return "wrong table size";
+    }
+    //The header keeps everything after it aligned
+    uint64_t const * const table = (uint64_t const *) (bytes + sizeof(header));
+    uint32_t const * const ranks = (uint32_t const *) (table + STATE_TABLE_WORDS);
+    if (header.checksum != database_checksum(table, ranks, (uint8_t const *) (ranks + RANK_BLOCKS), header.annotated)) {
+        return "checksum mismatch";
+    } else if (header.annotated && header.annotated != packed_count(table)) {
+        return "annotations don't match the table";
+    }
+    return nullptr;
+}
+
+//Loads a table written by write_database. The file is mapped read only where we can,
+//so processes using the same file share one copy of it in memory.
+//The map is read only: it can be looked up, but not solved into or reset.
+//Returns null on error, and sets error to the reason.
+GridStateMap* load_database(char const * const path, char const ** error) {
+    GridStateMap* mpt = malloc(sizeof(GridStateMap));
+    if (!mpt) {
+        *error = "allocation error";
+        return nullptr;
+    }
+    init_tables();
+    init_arena(&mpt->arena);
+    init_queue(&mpt->frontier);
+    mpt->best = nullptr;
+    mpt->ranks = nullptr;
+    mpt->annotated = 0;
+    mpt->scratch = 0;
+    mpt->threads = 0;
+    mpt->mapping = nullptr;
+    mpt->mapping_size = 0;
+    mpt->is_static = false;
+
+    uint8_t* bytes = nullptr;
+    size_t size = 0;
+#if HAVE_MMAP
+    int const fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = st.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            mpt->mapping = mapping;
+            mpt->mapping_size = size;
+            bytes = mapping;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#else
+    FILE* file = fopen(path, "rb");
+    if (file && fseek(file, 0, SEEK_END) == 0) {
+        long const end = ftell(file);
+        if (end > 0 && fseek(file, 0, SEEK_SET) == 0 && (bytes = arena_alloc(&mpt->arena, end))) {
+            size = fread(bytes, 1, end, file);
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
+#endif
+    if (!bytes) {
+        *error = "could not read the file";
+    } else {
+        *error = check_database(bytes, size);
+    }
+    if (*error) {
+        destroy_map(mpt);
+        return nullptr;
+    }
+    DatabaseHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    mpt->data = (uint64_t*) (bytes + sizeof(header));
+    if (header.annotated) {
+        mpt->ranks = (uint32_t*) (mpt->data + STATE_TABLE_WORDS);
+        mpt->best = (uint8_t*) (mpt->ranks + RANK_BLOCKS);
+        mpt->annotated = header.annotated;
+    }
+    return mpt;
+}
+
+
+//Embedded solution table: the solved states and best moves compiled into the program.
+//Generate the header with --emit-table, then build with -DEMBEDDED_TABLE, see the README.
+
+#ifdef EMBEDDED_TABLE
+#include "tictactoe_table.h"
+
+static_assert(EMBEDDED_X_DIM == GRID_X_DIM && EMBEDDED_Y_DIM == GRID_Y_DIM && EMBEDDED_K == GRID_K,
+    "tictactoe_table.h was generated for another board size");
+
+//Returns the embedded table as a read only map. It needs no solving and no heap.
+//Returns null if the table doesn't hang together, which a fresh --emit-table fixes.
+GridStateMap* embedded_map() {
+    static GridStateMap map;
+    init_tables();
+    init_arena(&map.arena);
+    init_queue(&map.frontier);
+    map.data = (uint64_t*) EMBEDDED_STATES;
+    map.best = (uint8_t*) EMBEDDED_BEST;
+    map.ranks = (uint32_t*) EMBEDDED_RANKS;
+    map.annotated = sizeof(EMBEDDED_BEST);
+    map.scratch = 0;
+    map.threads = 0;
+    map.mapping = nullptr;
+    map.mapping_size = 0;
+    map.is_static = true;
+    bool const whole = sizeof(EMBEDDED_STATES) == STATE_TABLE_BYTES && sizeof(EMBEDDED_RANKS) == RANK_BLOCKS * sizeof(uint32_t)
+        && packed_count(map.data) == map.annotated;
+    return whole ? &map : nullptr;
+}
+#endif
+
+//Returns a map with the whole game solved: the embedded table if embedded is true,
+//or else loaded from db_path if it isn't null, or else solved with solver, on threads threads
+//if it can use more than one (0 for one per core).
+//Returns null on error, after printing why.
+GridStateMap* solved_map(Solver solver, size_t threads, char const * const db_path, bool embedded) {
+#ifdef EMBEDDED_TABLE
+    if (embedded) {
+        GridStateMap* mpt = embedded_map();
+        if (!mpt) {
+            fprintf(stderr, "The embedded table doesn't match this build, regenerate it with --emit-table\n");
+        }
+        return mpt;
+    }
+#else
+    (void) embedded;
+#endif
+    if (db_path) {
+        char const * error = nullptr;
+        GridStateMap* mpt = load_database(db_path, &error);
+        if (!mpt) {
+            fprintf(stderr, "Could not load %s: %s\n", db_path, error);
+        }
+        return mpt;
+    }
+    GridStateMap* mpt = new_map();
+    Grid start;
+    reset(&start);
+    if (mpt) {
+        mpt->threads = threads;
+    }
+    if (!mpt || solver(mpt, &start) == UNKNOWN) {
+        fprintf(stderr, "Allocation error\n");
+        destroy_map(mpt);
+        return nullptr;
+    }
+    return mpt;
+}
+
+//Prints size bytes of data as a C array called name.
+void print_uint8_array(char const * const name, uint8_t const * const data, size_t size) {
+    printf("static uint8_t const %s[%zu] = {", name, size);
+    for (size_t i = 0; i < size; i++) {
+        printf(i % 24 == 0 ? "\n    %u," : " %u,", data[i]);
+    }
+    printf("\n};\n");
+}
+
+//Prints the ranks as a C array called name.
+void print_ranks_array(char const * const name, uint32_t const * const ranks) {
+    printf("static uint32_t const %s[%zu] = {", name, RANK_BLOCKS);
+    for (size_t i = 0; i < RANK_BLOCKS; i++) {
+        printf(i % 8 == 0 ? "\n    %lu," : " %lu,", (unsigned long) ranks[i]);
+    }
+    printf("\n};\n");
+}
+
+//Prints the packed states as a C array called name.
+void print_packed_array(char const * const name, uint64_t const * const data) {
+    printf("static uint64_t const %s[%zu] = {", name, STATE_TABLE_WORDS);
+    for (size_t i = 0; i < STATE_TABLE_WORDS; i++) {
+        printf(i % 4 == 0 ? "\n    0x%016llxu," : " 0x%016llxu,", (unsigned long long) data[i]);
+    }
+    printf("\n};\n");
+}
+
+//Solves the game, and prints it as the tictactoe_table.h header.
+//Uses the retrograde solver, as the table needs its annotations.
+int emit_table() {
+    GridStateMap* mpt = solved_map(calculate_position_retrograde, 0, nullptr, false);
+    if (!mpt) {
+        return EXIT_FAILURE;
+    }
+    printf("//Generated by tictactoe --emit-table, do not edit.\n\n");
+    printf("#define EMBEDDED_X_DIM %d\n", GRID_X_DIM);
+    printf("#define EMBEDDED_Y_DIM %d\n", GRID_Y_DIM);
+    printf("#define EMBEDDED_K %d\n\n", GRID_K);
+    print_packed_array("EMBEDDED_STATES", mpt->data);
+    printf("\n");
+    print_ranks_array("EMBEDDED_RANKS", mpt->ranks);
+    printf("\n");
+    print_uint8_array("EMBEDDED_BEST", mpt->best, mpt->annotated);
+    destroy_map(mpt);
+    return EXIT_SUCCESS;
+}
+
+//Checks the embedded table against a fresh solve.
+int verify_table() {
+#ifdef EMBEDDED_TABLE
+    GridStateMap const * const embedded = solved_map(nullptr, 0, nullptr, true);
+    GridStateMap* fresh = embedded ? solved_map(calculate_position_retrograde, 0, nullptr, false) : nullptr;
+    if (!fresh) {
+        return EXIT_FAILURE;
+    }
+    size_t differences = 0;
+    for (size_t i = 0; i < STATE_TABLE_SIZE; i++) {
+        differences += packed_get(embedded->data, i) != packed_get(fresh->data, i)
+            || map_annotation(embedded, i) != map_annotation(fresh, i);
+    }
+    destroy_map(fresh);
+    if (differences) {
+        printf("Embedded table differs from a fresh solve in %zu slots\n", differences);
+        return EXIT_FAILURE;
+    }
+    printf("Embedded table matches a fresh solve\n");
+    return EXIT_SUCCESS;
+#else
+    printf("Built without an embedded table, see -DEMBEDDED_TABLE\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+#endif
+
+//Same as solve_and_report, with the alpha-beta search.
+//Searches from the empty board with the given budget per move and threads, see Search, and prints the result.
+int search_and_report(double move_time, uint64_t move_nodes, size_t threads) {
+    Search* spt = new_search();
+    if (!spt) {
+        printf("Allocation error\n");
+        return EXIT_FAILURE;
+    }
+    spt->move_time = move_time;
+    spt->move_nodes = move_nodes;
+    spt->threads = threads;
+    Grid start;
+    reset(&start);
+
+    double const begin = seconds_now();
+    size_t best = GRID_TOTAL;
+    int const score = search_position(spt, &start, &best);
+    double const elapsed = seconds_now() - begin;
+
+    printf("Solver: alpha-beta\n");
+    printf("Threads: %zu\n", GRID_TOTAL >= PARALLEL_MIN_EMPTIES ? thread_count(threads) : 1);
+    if (spt->complete || score != 0) {
+        printf("Result: %s\n", state_to_string(score_to_state(score, start.player)));
+    } else {
+        printf("Result: not known after %zu moves deep\n", spt->depth);
+    }
+    if (spt->complete || score > 0) {
+        printf("Game length: %zu moves\n", score_to_plies(score, GRID_TOTAL));
+    }
+    if (move_time || move_nodes) {
+        printf("Depth: %zu moves%s\n", spt->depth, spt->complete ? ", to the end of the game" : "");
+    }
+    printf("Best move: %zu %zu\n", best % GRID_X_DIM, best / GRID_X_DIM);
+    printf("Nodes: %llu\n", (unsigned long long) spt->nodes);
+    printf("Table memory: %zu bytes\n", SEARCH_TABLE_SIZE * sizeof(SearchEntry));
+    printf("Table hits: %llu, misses: %llu, collisions: %llu, overwrites: %llu\n",
+        (unsigned long long) spt->hits, (unsigned long long) spt->misses,
+        (unsigned long long) spt->collisions, (unsigned long long) spt->overwrites);
+    printf("Time: %.6f s\n", elapsed);
+    printf("Nodes per second: %.0f\n", spt->nodes / elapsed);
+    destroy_search(spt);
+    return EXIT_SUCCESS;
+}
+
+//Batch mode, for answering many positions without the prompts.
+
+//Each input line is a position: GRID_TOTAL tiles row by row as X, O or E (or .),
+//then a space and X or O for the side to move. Blank lines and lines starting with # are skipped.
+//Each output line is the position, its result as X, O or D for a draw, the best move as x y,
+//or - - if the game is over, and the moves left in the game with best play, or - if not known.
+//Unreadable or unreachable positions get a ? instead of a result.
+
+enum {
+    OUTPUT_BUFFER_SIZE = 1 << 16,
+};
+
+//Output is collected here and written out in big chunks, instead of one write per line.
+typedef struct OutputBuffer OutputBuffer;
+struct OutputBuffer {
+    FILE* file;
+    size_t used;
+    char data[OUTPUT_BUFFER_SIZE];
+};
+
+void flush_output(OutputBuffer* out) {
+    fwrite(out->data, 1, out->used, out->file);
+    out->used = 0;
+}
+
+//Makes room for an input line plus its answer.
+char* output_line(OutputBuffer* out) {
+    if (OUTPUT_BUFFER_SIZE - out->used < 2 * LINE_MAX) {
+        flush_output(out);
+    }
+    return out->data + out->used;
+}
+
+//Reads a position in the batch format into b.
+//Returns false if the line isn't one, or the piece counts don't fit the side to move.
+bool parse_position(char const * const line, BitGrid* b) {
+    BitGrid read = {0, 0, false};
+    for (size_t i = 0; i < GRID_TOTAL; i++) {
+        switch (line[i]) {
+        case 'X':
+            read.x |= (BitMask) 1 << i;
+            break;
+        case 'O':
+            read.o |= (BitMask) 1 << i;
+            break;
+        case 'E':
+        case '.':
+            break;
+        default:
+            return false;
+        }
+    }
+    if (line[GRID_TOTAL] != ' ' || (line[GRID_TOTAL + 1] != 'X' && line[GRID_TOTAL + 1] != 'O')) {
+        return false;
+    }
+    read.o_turn = line[GRID_TOTAL + 1] == 'O';
+    //X goes first, so X has one more piece than O when it's O's turn, and the same otherwise.
+    if (count_tiles(read.x) != count_tiles(read.o) + read.o_turn) {
+        return false;
+    }
+    *b = read;
+    return true;
+}
+
+char state_to_code(WinState const state) {
+    switch (state) {
+    case X_WIN:
+        return 'X';
+    case O_WIN:
+        return 'O';
+    case DRAW:
+        return 'D';
+    default:
+        return '?';
+    }
+}
+
+//Positions are read in blocks, and each block is checked for finished games in one bitgrid_winners call.
+enum {
+    BATCH_BLOCK = 256,
+};
+
+typedef struct BatchBlock BatchBlock;
+struct BatchBlock {
+    size_t count;
+    char lines[BATCH_BLOCK][LINE_MAX];
+    size_t lengths[BATCH_BLOCK];
+    bool parsed[BATCH_BLOCK];
+    BitGrid boards[BATCH_BLOCK];
+    BitMask xs[BATCH_BLOCK]; //Empty for lines that aren't positions
+    BitMask os[BATCH_BLOCK];
+    uint8_t over[BATCH_BLOCK]; //From bitgrid_winners
+};
+
+//Reads the next block of positions from in, and checks which games are over. Returns false once in is done.
+bool read_batch_block(FILE* in, BatchBlock* block, size_t* line_number) {
+    block->count = 0;
+    bool more = true;
+    while (block->count < BATCH_BLOCK && (more = fgets(block->lines[block->count], LINE_MAX, in) != nullptr)) {
+        char* line = block->lines[block->count];
+        ++*line_number;
+        size_t const length = strcspn(line, "\r\n");
+        //A line that doesn't fit is answered as unreadable, with what fit of it, and the rest is skipped.
+        bool const too_long = line[length] == '\0' && length == LINE_MAX - 1 && !feof(in);
+        if (too_long) {
+            fprintf(stderr, "Line %zu is longer than %d characters\n", *line_number, LINE_MAX - 2);
+            for (int c = fgetc(in); c != EOF && c != '\n'; c = fgetc(in)) {
+            }
+        }
+        line[length] = '\0';
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        size_t const i = block->count++;
+        block->lengths[i] = length;
+        block->parsed[i] = !too_long && length == GRID_TOTAL + 2 && parse_position(line, &block->boards[i]);
+        block->xs[i] = block->parsed[i] ? block->boards[i].x : 0;
+        block->os[i] = block->parsed[i] ? block->boards[i].o : 0;
+    }
+    bitgrid_winners(block->xs, block->os, block->count, block->over);
+    return more;
+}
+
+//Answers position i of the block, see run_batch.
+void answer_position(OutputBuffer* out, BatchBlock const * const block, size_t i, GridStateMap* mpt, Search* spt, Mcts* mcts) {
+#if !GRID_DENSE
+    (void) mpt;
+#endif
+    BitGrid const b = block->boards[i];
+    Grid g;
+    WinState state = UNKNOWN;
+    size_t best = GRID_TOTAL;
+    size_t plies = GRID_TOTAL + 1; //Unknown
+    if (block->parsed[i]) {
+        bitgrid_to_grid(b, &g);
+        WinState const over = block->over[i];
+#if GRID_DENSE
+        if (mpt) {
+            //Positions the game can't reach aren't in the table.
+            state = map_lookup_with_insert(mpt, b, false, UNKNOWN);
+            if (state != UNKNOWN && over == UNKNOWN) {
+                best = best_move_from_map(mpt, &g);
+            }
+            if (state != UNKNOWN) {
+                plies = plies_from_map(mpt, &g);
+            }
+        }
+#endif
+        if (spt || mcts) {
+            if (over == X_WIN || over == O_WIN) {
+                //Only the side that just moved can have a line.
+                Player const winner = (Player) over;
+                bool const possible = winner != bitgrid_player(b) && !mask_has_line(winner == X_PL ? b.o : b.x);
+                state = possible ? over : UNKNOWN;
+                plies = possible ? 0 : plies;
+            } else if (over == DRAW) {
+                state = DRAW;
+                plies = 0;
+            } else if (mcts) {
+                best = best_move_from_mcts(mcts, &g);
+            } else {
+                int const score = search_position(spt, &g, &best);
+                //Out of time, only a win or a loss is certain, and only a win's length.
+                if (spt->complete || score != 0) {
+                    state = score_to_state(score, g.player);
+                }
+                if (spt->complete || score > 0) {
+                    plies = score_to_plies(score, count_tiles(bitgrid_empty(b)));
+                }
+            }
+        }
+    }
+
+    char* iter = output_line(out);
+    memcpy(iter, block->lines[i], block->lengths[i]);
+    iter += block->lengths[i];
+    *iter++ = ' ';
+    *iter++ = state_to_code(state);
+    if (best < GRID_TOTAL) {
+        iter += sprintf(iter, " %zu %zu", best % GRID_X_DIM, best / GRID_X_DIM);
+    } else {
+        memcpy(iter, " - -", 4);
+        iter += 4;
+    }
+    if (plies <= GRID_TOTAL) {
+        iter += sprintf(iter, " %zu\n", plies);
+    } else {
+        memcpy(iter, " -\n", 3);
+        iter += 3;
+    }
+    out->used = iter - out->data;
+}
+
+//Answers every position in in, writing the answers to out and the throughput to stderr.
+//Uses the map if it isn't null, which must have the whole game solved, so answers are only lookups.
+//Otherwise each position is searched, with a transposition table shared between them,
+//or with Monte Carlo tree search if mcts isn't null, which only gives a move.
+//Returns EXIT_FAILURE on allocation error.
+int run_batch(FILE* in, FILE* out_file, GridStateMap* mpt, Search* spt, Mcts* mcts) {
+    OutputBuffer* out = malloc(sizeof(OutputBuffer));
+    BatchBlock* block = malloc(sizeof(BatchBlock));
+    if (!out || !block) {
+        free(out);
+        free(block);
+        fprintf(stderr, "Allocation error\n");
+        return EXIT_FAILURE;
+    }
+    out->file = out_file;
+    out->used = 0;
+
+    double const begin = seconds_now();
+    size_t positions = 0;
+    size_t line_number = 0;
+    bool more = true;
+    while (more) {
+        more = read_batch_block(in, block, &line_number);
+        for (size_t i = 0; i < block->count; i++) {
+            answer_position(out, block, i, mpt, spt, mcts);
+        }
+        positions += block->count;
+    }
+    flush_output(out);
+    double const elapsed = seconds_now() - begin;
+
+    fprintf(stderr, "Positions: %zu\n", positions);
+    fprintf(stderr, "Win checks: %s\n", WINNERS_NAME);
+    fprintf(stderr, "Answer time: %.6f s\n", elapsed);
+    fprintf(stderr, "Positions per second: %.0f\n", elapsed > 0 ? positions / elapsed : 0.0);
+
+    free(block);
+    free(out);
+    return EXIT_SUCCESS;
+}
+
+//Option values. These read the whole of text, or fail and print why, naming the option.
+
+//A whole number from min to max.
+bool parse_option_count(char const * const option, char const * const text, uint64_t min, uint64_t max, uint64_t* value) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long const read = strtoull(text, &end, 10);
+    //strtoull would take a sign or spaces first, and wrap a minus sign around.
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || read < min || read > max) {
+        fprintf(stderr, "%s needs a whole number from %llu to %llu, not %s\n",
+            option, (unsigned long long) min, (unsigned long long) max, text);
+        return false;
+    }
+    *value = read;
+    return true;
+}
+
+//A time in milliseconds, 0 or more, as seconds.
+bool parse_option_milliseconds(char const * const option, char const * const text, double* seconds) {
+    char* end = nullptr;
+    double const read = strtod(text, &end);
+    if (end == text || *end != '\0' || !isfinite(read) || read < 0) {
+        fprintf(stderr, "%s needs a number of milliseconds, not %s\n", option, text);
+        return false;
+    }
+    *seconds = read / 1000;
+    return true;
+}
+
+//bench.c includes this file for the engine, and leaves out main with TICTACTOE_NO_MAIN.
+#ifndef TICTACTOE_NO_MAIN
+/*
+Options:
+--retrograde: use the retrograde solver, the default. It annotates the table with the best moves.
+--bfs: use the breadth first search instead of the retrograde solver.
+--layered: use the layered solver, which runs on every core. With --solve it also times the
+    retrograde solver, or the breadth first search with --bfs, on one thread for the speedup.
+--threads n: run the layered solver, the search and Monte Carlo tree search on n threads,
+    at most THREADS_MAX. 0, the default, is one per core.
+--movetime ms: give the search at most ms milliseconds a move. It deepens a ply at a time and plays
+    the best move of the last depth it finished. Implies --search.
+--movenodes n: the same with a budget of n nodes a move.
+--mcts: use Monte Carlo tree search instead, on --threads threads. It plays the move
+    that did best in random games, for boards too big to search. --movetime limits it too.
+--playouts n: give --mcts n playouts a move. Implies --mcts.
+--search: use the alpha-beta search instead of a solved table, the default on boards over DENSE_MAX_TILES.
+--solve: solve from the empty board, print the result and timing, and exit.
+--batch [file]: answer the positions in file, or stdin, and exit. See run_batch.
+--perft [depth]: count the game tree from the empty board down to depth moves, at least 1, or to the end,
+    on one thread and then on --threads threads, and exit.
+--stats: with --solve or --batch, print the solver's counters and how full the table is.
+    The counters need a build with -DSOLVER_STATS. When playing with --search, print how much
+    of each move's search was done by pondering while you thought.
+--write-db file: solve the game, save the table to file, and exit.
+--db file: use the table saved in file instead of solving the game.
+--emit-table: solve the game and print it as tictactoe_table.h, for building with -DEMBEDDED_TABLE.
+--verify-table: check the embedded table against a fresh solve, and exit.
+--runtime: solve the game at startup, even if the table is embedded.
+*/
+int main(int argc, char** argv) {
+
+    init_tables();
+
+    bool use_search = !GRID_DENSE;
+    bool solve_only = false;
+    bool stats = false;
+    double move_time = 0; //Seconds per search move, 0 for no limit
+    uint64_t move_nodes = 0;
+    bool use_mcts = false;
+    uint64_t move_playouts = 0; //Per mcts move, 0 for no limit
+    size_t perft_depth = 0; //0 for no perft
+    size_t threads = 0; //0 for one per core
+    uint64_t value = 0; //Numbers read from the options
+    bool batch = false;
+    char const * batch_file = nullptr;
+#if GRID_DENSE
+    Solver solver = calculate_position_retrograde;
+    char const * solver_name = "retrograde";
+    bool layered = false;
+    char const * db_path = nullptr;
+    char const * write_db_path = nullptr;
+    bool emit = false;
+    bool verify = false;
+#ifdef EMBEDDED_TABLE
+    bool embedded = true;
+#else
+    bool embedded = false;
+#endif
+#endif
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--search") == 0) {
+            use_search = true;
+        } else if (strcmp(argv[i], "--solve") == 0) {
+            solve_only = true;
+        } else if (strcmp(argv[i], "--perft") == 0) {
+            perft_depth = GRID_TOTAL;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                if (!parse_option_count("--perft", argv[++i], 1, SIZE_MAX, &value)) {
+                    return EXIT_FAILURE;
+                }
+                perft_depth = value;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc) {
+            if (!parse_option_milliseconds("--movetime", argv[++i], &move_time)) {
+                return EXIT_FAILURE;
+            }
+            use_search = true;
+        } else if (strcmp(argv[i], "--movenodes") == 0 && i + 1 < argc) {
+            if (!parse_option_count("--movenodes", argv[++i], 0, UINT64_MAX, &move_nodes)) {
+                return EXIT_FAILURE;
+            }
+            use_search = true;
+        } else if (strcmp(argv[i], "--mcts") == 0) {
+            use_mcts = true;
+            use_search = true;
+        } else if (strcmp(argv[i], "--playouts") == 0 && i + 1 < argc) {
+            if (!parse_option_count("--playouts", argv[++i], 0, UINT64_MAX, &move_playouts)) {
+                return EXIT_FAILURE;
+            }
+            use_mcts = true;
+            use_search = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!parse_option_count("--threads", argv[++i], 0, THREADS_MAX, &value)) {
+                return EXIT_FAILURE;
+            }
+            threads = value;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                batch_file = argv[++i];
+            }
+#if GRID_DENSE
+        } else if (strcmp(argv[i], "--bfs") == 0) {
+            solver = calculate_position;
+            solver_name = "bfs";
+        } else if (strcmp(argv[i], "--retrograde") == 0) {
+            solver = calculate_position_retrograde;
+            solver_name = "retrograde";
+        } else if (strcmp(argv[i], "--layered") == 0) {
+            layered = true;
+        } else if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
+            db_path = argv[++i];
+        } else if (strcmp(argv[i], "--write-db") == 0 && i + 1 < argc) {
+            write_db_path = argv[++i];
+        } else if (strcmp(argv[i], "--emit-table") == 0) {
+            emit = true;
+        } else if (strcmp(argv[i], "--verify-table") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--runtime") == 0) {
+            embedded = false;
+#endif
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (perft_depth) {
+        return perft_and_report(perft_depth, threads);
+    }
+#if GRID_DENSE
+    if (layered && solve_only && !use_search) {
+        return solve_layered_and_report(solver, solver_name, threads, stats);
+    } else if (layered) {
+        solver = calculate_position_layered;
+    }
+    if (emit) {
+        return emit_table();
+    } else if (verify) {
+        return verify_table();
+    }
+    //A database or the embedded table is used instead of solving, unless one is given on purpose.
+    embedded = embedded && !db_path;
+    if (write_db_path) {
+        GridStateMap* mpt = solved_map(solver, threads, nullptr, false);
+        if (!mpt) {
+            return EXIT_FAILURE;
+        }
+        bool const ok = write_database(mpt, write_db_path);
+        destroy_map(mpt);
+        if (!ok) {
+            printf("Could not write %s\n", write_db_path);
+            return EXIT_FAILURE;
+        }
+        printf("Wrote %s\n", write_db_path);
+        return EXIT_SUCCESS;
+    }
+#endif
+
+    //The computer either solves the whole game up front, or searches on each of its turns,
+    //with alpha-beta or Monte Carlo tree search.
+    GridStateMap* mpt = nullptr;
+    Search* spt = nullptr;
+    Mcts* mcts = nullptr;
+
+    if (batch) {
+        FILE* in = batch_file ? fopen(batch_file, "r") : stdin;
+        if (!in) {
+            fprintf(stderr, "Could not open %s\n", batch_file);
+            return EXIT_FAILURE;
+        }
+        double const begin = seconds_now();
+#if GRID_DENSE
+        if (!use_search) {
+            mpt = solved_map(solver, threads, db_path, embedded);
+        }
+#endif
+        if (use_mcts && !(mcts = new_mcts(move_time, move_playouts))) {
+            fprintf(stderr, "Allocation error\n");
+        } else if (use_search && !use_mcts && !(spt = new_search())) {
+            fprintf(stderr, "Allocation error\n");
+        } else if (spt) {
+            spt->move_time = move_time;
+            spt->move_nodes = move_nodes;
+            spt->threads = threads;
+        } else if (mcts) {
+            mcts->threads = threads;
+        }
+        int ret = EXIT_FAILURE;
+        if (mpt || spt || mcts) {
+            fprintf(stderr, "Setup time: %.6f s\n", seconds_now() - begin);
+            ret = run_batch(in, stdout, mpt, spt, mcts);
+        }
+        if (stats) {
+            print_stats(stderr, mpt);
+        }
+        if (batch_file) {
+            fclose(in);
+        }
+#if GRID_DENSE
+        destroy_map(mpt);
+#endif
+        destroy_search(spt);
+        destroy_mcts(mcts);
+        return ret;
+    }
+    if (solve_only) {
+        if (use_mcts) {
+            return mcts_and_report(move_time, move_playouts, threads);
+        }
+#if GRID_DENSE
+        if (!use_search) {
+            return solve_and_report(solver, solver_name, stats);
+        }
+#endif
+        return search_and_report(move_time, move_nodes, threads);
+    }
+
+    Grid BOARD;
+    Grid* bpt = reset(&BOARD);
+
+    BOARD.player = X_PL;
+    char line[LINE_MAX];
+
+    size_t move_x = 0;
+    size_t move_y = 0;
+    Player current_player = X_PL;
+
+    printf("Would you like to play with a computer? (y/n) \n");
+
+    char computer = '\0';
+    while(true) {
+        if (fgets(line, sizeof(line), stdin)) {
+            if (sscanf(line, "%c", &computer) == 1) {
+                if (computer == 'Y' || computer == 'N' || computer == 'y' || computer == 'n') {
+                    break;
+                } 
+            } 
+            //Error input
+            printf("Please input either y or n.\n");
+        }
+    }
+    //Loop with two human players
+    if (computer == 'n' || computer == 'N') {
+        while(true) {
+            printf("Current grid: \n");
+            print_grid(bpt);
+            printf("It's player %s's turn! Make a move. \n", player_to_string(current_player));
+            if (fgets(line, sizeof(line), stdin)) {
+                if (sscanf(line, "%zu %zu", &move_x, &move_y) == 2 && get(bpt, move_x, move_y) == EMPTY) {
+                    move(bpt, move_x, move_y);
+                    //Switches current player
+                
+                    //Here are the end states:
+                    if (is_winning_move(bpt, move_x, move_y)) {
+                        printf("Player %s won! \n", player_to_string(current_player));
+                        print_grid(bpt);
+                        break;
+                    } else if (is_full(bpt)) {
+                        printf("It's a draw!\n");
+                        print_grid(bpt);
+                        break;
+                    }
+                    //Advances current player
+                    current_player = BOARD.player;
+                    continue;
+                } else {
+
+                    printf("Illegal move or failed read. Enter a move as x y, with 0<=x<%d, 0<=y<%d.\n", GRID_X_DIM, GRID_Y_DIM);
+                }
+            } else {
+                printf("Failed to read line. Enter a move as x y, with 0<=x<%d, 0<=y<%d.\n", GRID_X_DIM, GRID_Y_DIM);
+            }
+        }
+    } 
+
+    //Loop to play with computer
+    else {
+#if GRID_DENSE
+        if (!use_search && !(mpt = solved_map(solver, threads, db_path, embedded))) {
+            return EXIT_FAILURE;
+        }
+#endif
+        if (use_mcts && !(mcts = new_mcts(move_time, move_playouts))) {
+            printf("Allocation error\n");
+            return EXIT_FAILURE;
+        } else if (use_search && !use_mcts && !(spt = new_search())) {
+            printf("Allocation error\n");
+            return EXIT_FAILURE;
+        } else if (spt) {
+            spt->move_time = move_time;
+            spt->move_nodes = move_nodes;
+            spt->threads = threads;
+        } else if (mcts) {
+            mcts->threads = threads;
+        }
+
+        //Asks to go first or second
+
+        int response = 0;
+        Player computer_player = EMPTY;
+
+        printf("Would you like to go first or second? (1/2)\n");
+        while(true) {
+            if (fgets(line, sizeof(line), stdin)) {
+                if (sscanf(line, "%d ", &response) == 1) {
+                    if (response == 1) {
+                        computer_player = O_PL;
+                        break;
+                    } else if (response == 2) {
+                        computer_player = X_PL;
+                        break;
+                    }
+                }
+                printf("Please input either 1 or 2\n");
+            }
+        }
+
+        //Print the empty board once:
+        //Always take the center if possible
+        if (computer_player == X_PL) {
+            printf("Current grid: \n");
+            print_grid(bpt);
+            move(bpt, TILE_ORDER[0] % GRID_X_DIM, TILE_ORDER[0] / GRID_X_DIM);
+        }
+        //The search ponders on the board while you think.
+        Ponder ponder;
+        ponder.running = false;
+        while(true) {
+            if (spt && !ponder.running) {
+                start_pondering(&ponder, spt, bpt);
+            }
+            printf("Current grid: \n");
+            print_grid(bpt);
+            printf("It's your turn! Make a move. \n");
+            if (fgets(line, sizeof(line), stdin)) {
+                if (sscanf(line, "%zu %zu", &move_x, &move_y) == 2 && get(bpt, move_x, move_y) == EMPTY) {
+                    if (spt) {
+                        stop_pondering(&ponder, spt);
+                    }
+                    move(bpt, move_x, move_y);
+                    printf("Current grid: \n");
+                    print_grid(bpt);
+                    //Here are the end states:
+                    if (is_winning_move(bpt, move_x, move_y)) {
+                        printf("You won! \n");
+                        print_grid(bpt);
+                        break;
+                    } else if (is_full(bpt)) {
+                        printf("It's a draw!\n");
+                        print_grid(bpt);
+                        break;
+                    }
+
+                    //Find computer move now
+                    size_t best = GRID_TOTAL;
+                    if (spt) {
+                        PonderReport report;
+                        best = best_move_from_ponder(&ponder, spt, bpt, move_x + move_y * GRID_X_DIM, &report);
+                        if (stats) {
+                            printf("Pondered %.3f s, searched %.3f s after your move, %.0f%% of the work was hidden%s\n",
+                                report.pondered, report.searched, 100 * ponder_hidden(&report),
+                                report.hit ? ", the move was ready" : "");
+                        }
+                    }
+                    if (mcts) {
+                        best = best_move_from_mcts(mcts, bpt);
+                    }
+#if GRID_DENSE
+                    if (mpt) {
+                        best = best_move_from_map(mpt, bpt);
+                    }
+#endif
+                    if (!(best < GRID_TOTAL)) {
+                        printf("Error, lookup failed.");
+#if GRID_DENSE
+                        destroy_map(mpt);
+#endif
+                        destroy_search(spt);
+                        destroy_mcts(mcts);
+                        return EXIT_FAILURE;
+                    }
+                    move(bpt, best % GRID_X_DIM, best / GRID_X_DIM);
+
+                    if (has_won(bpt)) {
+                        printf("You lost!");
+                        print_grid(bpt);
+                        break;
+                    } else if (is_full(bpt)) {
+                        printf("It's a draw!\n");
+                        print_grid(bpt);
+                        break;
+                    }
+                    continue;
+                } 
+            } 
+            printf("Failed to read line. Enter a move as x y, with 0<=x<%d, 0<=y<%d.\n", GRID_X_DIM, GRID_Y_DIM);
+        }
+
+#if GRID_DENSE
+        destroy_map(mpt);
+#endif
+        destroy_search(spt);
+        destroy_mcts(mcts);
+    }
+    return EXIT_SUCCESS;
+    
+}
+#endif